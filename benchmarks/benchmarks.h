@@ -0,0 +1,702 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "yecs/yecs.h"
+
+/**
+ * @brief Run a function several times and print the best time.
+ *
+ * @param name Benchmark name.
+ * @param num_runs Number of times to run a function.
+ * @param f Function to benchmark.
+ **/
+template <typename F>
+inline void RunBenchmark(const char* name, std::size_t num_runs, F&& f)
+{
+    using namespace std::chrono;
+
+    auto best = duration<double, std::milli>::max();
+
+    for (auto i = 0u; i < num_runs; ++i)
+    {
+        auto start = high_resolution_clock::now();
+        f();
+        best = std::min(best, duration<double, std::milli>(high_resolution_clock::now() - start));
+    }
+
+    std::printf("%-60s %10.3f ms\n", name, best.count());
+}
+
+// Add, look up and remove components of a given storage type.
+template <typename StorageT>
+inline void BenchmarkComponentStorage(const char* name)
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumComponents = 100000;
+    constexpr std::size_t kNumRemovals   = 20000;
+    constexpr std::size_t kNumRuns       = 5;
+
+    std::vector<Entity> entities(kNumComponents);
+    for (auto i = 0u; i < kNumComponents; ++i) { entities[i] = MakeEntity(i, 0); }
+    std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+
+    std::string prefix(name);
+
+    RunBenchmark((prefix + ": add").c_str(), kNumRuns, [&entities]() {
+        StorageT storage;
+        for (auto e : entities) { storage.AddComponent(e); }
+    });
+
+    StorageT storage;
+    for (auto e : entities) { storage.AddComponent(e).x = 1.f; }
+
+    RunBenchmark((prefix + ": random lookup").c_str(), kNumRuns, [&entities, &storage]() {
+        volatile float sum = 0.f;
+        for (auto e : entities)
+        {
+            if (storage.HasComponent(e))
+            {
+                sum = sum + storage.GetComponent(e).x;
+            }
+        }
+    });
+
+    RunBenchmark((prefix + ": remove/add churn").c_str(), 1, [&entities, &storage]() {
+        for (auto i = 0u; i < kNumRemovals; ++i) { storage.RemoveComponent(entities[i]); }
+        for (auto i = 0u; i < kNumRemovals; ++i) { storage.AddComponent(entities[i]); }
+    });
+}
+
+inline void BenchmarkComponentStorages()
+{
+    using namespace yecs;
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    BenchmarkComponentStorage<DenseComponentStorage<Position>>("DenseComponentStorage");
+    BenchmarkComponentStorage<PagedComponentStorage<Position>>("PagedComponentStorage");
+}
+
+inline void BenchmarkEntityCreation()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    RunBenchmark("World::CreateEntity x 1M", 3, []() {
+        World world;
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity(); }
+    });
+
+    RunBenchmark("World::CreateEntity x 1M after destroying every other entity", 3, []() {
+        World               world;
+        std::vector<Entity> entities(kNumEntities);
+        for (auto i = 0u; i < kNumEntities; ++i) { entities[i] = world.CreateEntity().Build(); }
+        for (auto i = 0u; i < kNumEntities; i += 2) { world.DestroyEntity(entities[i]); }
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity(); }
+    });
+}
+
+namespace benchmarks
+{
+struct Position
+{
+    float x = 0.f;
+    float y = 0.f;
+    float z = 0.f;
+};
+
+struct Velocity
+{
+    float x = 1.f;
+    float y = 1.f;
+    float z = 1.f;
+};
+
+struct ArchetypePosition : Position
+{
+};
+
+struct ArchetypeVelocity : Velocity
+{
+};
+}  // namespace benchmarks
+
+inline void BenchmarkBulkEntityCreation()
+{
+    using namespace yecs;
+    using namespace benchmarks;
+
+    constexpr std::size_t kNumEntities = 500000;
+
+    RunBenchmark("World::CreateEntity().AddComponent<Position, Velocity> x 500K", 3, []() {
+        World world;
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>();
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity().AddComponent<Position>().AddComponent<Velocity>(); }
+    });
+
+    RunBenchmark("World::CreateEntity().AddComponent<...> x 500K, monotonic", 3, []() {
+        // Storages and tables grow in a region released at once with the world.
+        std::pmr::monotonic_buffer_resource resource;
+        WorldConfig                         config;
+        config.memory_resource = &resource;
+
+        World world(config);
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>();
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity().AddComponent<Position>().AddComponent<Velocity>(); }
+    });
+
+    RunBenchmark("World::CreateEntities(500K, Position, Velocity)", 3, []() {
+        World world;
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>();
+        world.CreateEntities(kNumEntities, Position{}, Velocity{});
+    });
+
+    RunBenchmark("World::CreateEntities(500K, source)", 3, []() {
+        World world;
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>();
+        world.CreateEntities(kNumEntities, world.CreateEntity().AddComponent<Position>().AddComponent<Velocity>().Build());
+    });
+}
+
+inline void BenchmarkBulkEntityDestruction()
+{
+    using namespace yecs;
+    using namespace benchmarks;
+
+    constexpr std::size_t kNumEntities = 1000000;
+    constexpr std::size_t kNumDestroyed = 100000;
+
+    auto destroy = [](const char* name, auto&& f) {
+        World world;
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>();
+
+        auto                entities = world.CreateEntities(kNumEntities, Position{}, Velocity{});
+        std::vector<Entity> doomed(entities.begin(), entities.end());
+        std::shuffle(doomed.begin(), doomed.end(), std::mt19937(42));
+        doomed.resize(kNumDestroyed);
+
+        RunBenchmark(name, 1, [&world, &doomed, &f]() { f(world, doomed); });
+    };
+
+    destroy("World::DestroyEntity x 100K of 1M", [](World& world, const std::vector<Entity>& doomed) {
+        for (auto entity : doomed) { world.DestroyEntity(entity); }
+    });
+
+    destroy("World::DestroyEntities(100K of 1M)",
+            [](World& world, const std::vector<Entity>& doomed) { world.DestroyEntities(doomed); });
+}
+
+namespace benchmarks
+{
+// Rigid body, only position and velocity are touched by integration.
+struct Body
+{
+    float x = 0.f, y = 0.f, z = 0.f;
+    float vx = 1.f, vy = 1.f, vz = 1.f;
+    float ax = 0.f, ay = 0.f, az = 0.f;
+    float mass = 1.f, drag = 0.f;
+};
+
+struct SoABody : Body
+{
+};
+}  // namespace benchmarks
+
+namespace yecs
+{
+template <>
+struct SoAFields<benchmarks::SoABody> : SoAFieldList<&benchmarks::SoABody::x,
+                                                     &benchmarks::SoABody::y,
+                                                     &benchmarks::SoABody::z,
+                                                     &benchmarks::SoABody::vx,
+                                                     &benchmarks::SoABody::vy,
+                                                     &benchmarks::SoABody::vz,
+                                                     &benchmarks::SoABody::ax,
+                                                     &benchmarks::SoABody::ay,
+                                                     &benchmarks::SoABody::az,
+                                                     &benchmarks::SoABody::mass,
+                                                     &benchmarks::SoABody::drag>
+{
+};
+
+template <>
+struct ComponentStorageTraits<benchmarks::SoABody>
+{
+    using StorageType = SoAComponentStorage<benchmarks::SoABody>;
+};
+
+template <>
+struct ComponentStorageTraits<benchmarks::ArchetypePosition>
+{
+    using StorageType = ArchetypeComponentStorage<benchmarks::ArchetypePosition>;
+};
+
+template <>
+struct ComponentStorageTraits<benchmarks::ArchetypeVelocity>
+{
+    using StorageType = ArchetypeComponentStorage<benchmarks::ArchetypeVelocity>;
+};
+}  // namespace yecs
+
+namespace benchmarks
+{
+// Physics integration using entity query and per entity lookups.
+struct QueryPhysicsSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        auto& positions  = access.Write<Position>();
+        auto& velocities = access.Read<Velocity>();
+
+        auto entities = entity_query().Filter([&velocities, &positions](yecs::Entity e) {
+            return positions.HasComponent(e) && velocities.HasComponent(e);
+        });
+
+        for (auto e : entities.entities())
+        {
+            auto& pos = positions.GetComponent(e);
+            auto& vel = velocities.GetComponent(e);
+            pos.x += vel.x;
+            pos.y += vel.y;
+            pos.z += vel.z;
+        }
+    }
+};
+
+// Physics integration using query terms matched against component masks.
+struct TermsPhysicsSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        entity_query.ForEach<yecs::With<Position, const Velocity>>(
+            [](yecs::Entity e, Position& pos, const Velocity& vel) {
+                pos.x += vel.x;
+                pos.y += vel.y;
+                pos.z += vel.z;
+            });
+    }
+};
+
+// Physics integration using a view.
+struct ViewPhysicsSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        access.View<Position, const Velocity>().ForEach([](yecs::Entity e, Position& pos, const Velocity& vel) {
+            pos.x += vel.x;
+            pos.y += vel.y;
+            pos.z += vel.z;
+        });
+    }
+};
+
+// Physics integration using a view processed in parallel.
+struct ParallelPhysicsSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        yecs::ParallelForEach(subflow,
+                              access.View<Position, const Velocity>(),
+                              [](yecs::Entity e, Position& pos, const Velocity& vel) {
+                                  pos.x += vel.x;
+                                  pos.y += vel.y;
+                                  pos.z += vel.z;
+                              });
+    }
+};
+
+// Physics integration using archetype chunks.
+struct ArchetypePhysicsSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        access.ArchetypeView<ArchetypePosition, const ArchetypeVelocity>().ForEachChunk(
+            [](std::size_t count, const yecs::Entity* entities, ArchetypePosition* pos, const ArchetypeVelocity* vel) {
+                for (auto i = 0u; i < count; ++i)
+                {
+                    pos[i].x += vel[i].x;
+                    pos[i].y += vel[i].y;
+                    pos[i].z += vel[i].z;
+                }
+            });
+    }
+};
+
+// Rigid body integration over an array of structures.
+struct AoSIntegrationSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        auto& bodies = access.Write<Body>();
+        for (auto i = 0u; i < bodies.size(); ++i)
+        {
+            auto& body = bodies[i];
+            body.x += body.vx;
+            body.y += body.vy;
+            body.z += body.vz;
+        }
+    }
+};
+
+// Rigid body integration over field arrays.
+struct SoAIntegrationSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        auto& bodies = access.Write<SoABody>();
+        auto  x      = bodies.data<&SoABody::x>();
+        auto  y      = bodies.data<&SoABody::y>();
+        auto  z      = bodies.data<&SoABody::z>();
+        auto  vx     = bodies.data<&SoABody::vx>();
+        auto  vy     = bodies.data<&SoABody::vy>();
+        auto  vz     = bodies.data<&SoABody::vz>();
+
+        for (auto i = 0u; i < bodies.size(); ++i)
+        {
+            x[i] += vx[i];
+            y[i] += vy[i];
+            z[i] += vz[i];
+        }
+    }
+};
+
+// Requests component storages many times.
+struct ComponentAccessSystem : public yecs::System
+{
+    static constexpr std::size_t kNumReads = 10000000;
+
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        for (auto i = 0u; i < kNumReads; ++i)
+        {
+            num_components += access.Read<Position>().size() + access.Read<Velocity>().size();
+        }
+    }
+
+    std::size_t num_components = 0;
+};
+
+// Enumerates all the entities several times.
+struct EntityQuerySystem : public yecs::System
+{
+    static constexpr std::size_t kNumQueries = 100;
+
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        for (auto i = 0u; i < kNumQueries; ++i) { num_entities += entity_query().entities().size(); }
+    }
+
+    std::size_t num_entities = 0;
+};
+
+// Walks moving entities found by matching masks or by a cached query.
+template <bool kCached>
+struct MovingQuerySystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        auto& positions = access.Write<Position>();
+
+        if constexpr (kCached)
+        {
+            for (auto entity : entity_query.Cached<Position, Velocity>()) { positions.GetComponent(entity).x += 1.f; }
+        }
+        else
+        {
+            auto moving = entity_query.WithComponents<Position, Velocity>();
+            for (auto entity : moving.entities()) { positions.GetComponent(entity).x += 1.f; }
+        }
+    }
+};
+
+// Counts moving entities not to the left of the origin with chained filters, materialized or lazy.
+template <bool kLazy>
+struct ChainedFilterSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        auto& positions  = access.Read<Position>();
+        auto& velocities = access.Read<Velocity>();
+
+        auto has_velocity = [&velocities](yecs::Entity e) { return velocities.HasComponent(e); };
+        auto is_right     = [&positions](yecs::Entity e) { return positions.GetComponent(e).x >= 0.f; };
+        auto is_even      = [](yecs::Entity e) { return (yecs::GetEntityIndex(e) & 1) == 0; };
+
+        auto all = entity_query();
+
+        if constexpr (kLazy)
+        {
+            all.Lazy().Filter(is_even).Filter(has_velocity).Filter(is_right).ForEach([this](yecs::Entity) {
+                ++num_entities;
+            });
+        }
+        else
+        {
+            num_entities += all.Filter(is_even).Filter(has_velocity).Filter(is_right).entities().size();
+        }
+    }
+
+    std::size_t num_entities = 0;
+};
+
+// Intersects entities having position with entities having velocity, plain or compressed.
+template <bool kCompressed>
+struct IntersectionSystem : public yecs::System
+{
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        using namespace yecs;
+
+        if constexpr (kCompressed)
+        {
+            auto positions  = entity_query.MatchCompressed<With<Position>>();
+            auto velocities = entity_query.MatchCompressed<With<Velocity>>();
+            num_entities += positions.Intersection(velocities).size();
+            memory_usage = positions.memory_usage() + velocities.memory_usage();
+        }
+        else
+        {
+            auto positions  = entity_query.Match<With<Position>>();
+            auto velocities = entity_query.Match<With<Velocity>>();
+            num_entities += positions.Intersection(velocities).entities().size();
+            memory_usage = (positions.entities().capacity() + velocities.entities().capacity()) * sizeof(Entity);
+        }
+    }
+
+    std::size_t num_entities = 0;
+    std::size_t memory_usage = 0;
+};
+
+// Create a world with half of the entities moving.
+template <typename PositionT = Position, typename VelocityT = Velocity>
+inline void PopulatePhysicsWorld(yecs::World& world, std::size_t num_entities)
+{
+    world.RegisterComponent<PositionT>();
+    world.RegisterComponent<VelocityT>();
+
+    for (auto i = 0u; i < num_entities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.template AddComponent<PositionT>();
+        if (i & 1)
+        {
+            builder.template AddComponent<VelocityT>();
+        }
+    }
+}
+}  // namespace benchmarks
+
+inline void BenchmarkViews()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    {
+        World world;
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<benchmarks::QueryPhysicsSystem>();
+        RunBenchmark("Physics step 1M entities: query + filter + GetComponent", 5, [&world]() { world.Run(); });
+    }
+
+    {
+        World world;
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<benchmarks::TermsPhysicsSystem>();
+        RunBenchmark("Physics step 1M entities: EntityQuery::ForEach<With<...>>", 5, [&world]() { world.Run(); });
+    }
+
+    {
+        World world;
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<benchmarks::ViewPhysicsSystem>();
+        RunBenchmark("Physics step 1M entities: View<Position, const Velocity>", 5, [&world]() { world.Run(); });
+    }
+
+    {
+        World world;
+        benchmarks::PopulatePhysicsWorld<benchmarks::ArchetypePosition, benchmarks::ArchetypeVelocity>(world,
+                                                                                                     kNumEntities);
+        world.RegisterSystem<benchmarks::ArchetypePhysicsSystem>();
+        RunBenchmark("Physics step 1M entities: ArchetypeView chunks", 5, [&world]() { world.Run(); });
+    }
+}
+
+inline void BenchmarkComponentAccess()
+{
+    using namespace yecs;
+
+    World world;
+    benchmarks::PopulatePhysicsWorld(world, 16);
+    world.RegisterSystem<benchmarks::ComponentAccessSystem>();
+    RunBenchmark("ComponentAccess::Read<T>() x 20M", 5, [&world]() { world.Run(); });
+}
+
+inline void BenchmarkSoA()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    {
+        World world;
+        world.RegisterComponent<benchmarks::Body>();
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity().AddComponent<benchmarks::Body>(); }
+        world.RegisterSystem<benchmarks::AoSIntegrationSystem>();
+        RunBenchmark("Integration 1M bodies: DenseComponentStorage (AoS)", 5, [&world]() { world.Run(); });
+    }
+
+    {
+        World world;
+        world.RegisterComponent<benchmarks::SoABody>();
+        for (auto i = 0u; i < kNumEntities; ++i) { world.CreateEntity().AddComponent<benchmarks::SoABody>(); }
+        world.RegisterSystem<benchmarks::SoAIntegrationSystem>();
+        RunBenchmark("Integration 1M bodies: SoAComponentStorage", 5, [&world]() { world.Run(); });
+    }
+}
+
+inline void BenchmarkEntityQuery()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    for (auto alive_every : {1u, 100u})
+    {
+        World               world;
+        std::vector<Entity> entities(kNumEntities);
+        for (auto i = 0u; i < kNumEntities; ++i) { entities[i] = world.CreateEntity().Build(); }
+        for (auto i = 0u; i < kNumEntities; ++i)
+        {
+            if (i % alive_every)
+            {
+                world.DestroyEntity(entities[i]);
+            }
+        }
+        world.RegisterSystem<benchmarks::EntityQuerySystem>();
+
+        auto name = "EntityQuery x 100, 1M slots, every " + std::to_string(alive_every) + " alive";
+        RunBenchmark(name.c_str(), 5, [&world]() { world.Run(); });
+    }
+}
+
+inline void BenchmarkCachedQuery()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 2000000;
+
+    auto run = [](const char* name, auto system) {
+        World world;
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<decltype(system)>();
+        RunBenchmark(name, 5, [&world]() { world.Run(); });
+    };
+
+    run("EntityQuery::WithComponents, 1M of 2M entities", benchmarks::MovingQuerySystem<false>());
+    run("EntityQuery::Cached, 1M of 2M entities", benchmarks::MovingQuerySystem<true>());
+}
+
+inline void BenchmarkEntityPipeline()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    auto run = [](const char* name, auto system) {
+        World world;
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<decltype(system)>();
+        RunBenchmark(name, 5, [&world]() { world.Run(); });
+    };
+
+    run("EntitySet::Filter x 3, 1M entities", benchmarks::ChainedFilterSystem<false>());
+    run("EntitySet::Lazy().Filter x 3, 1M entities", benchmarks::ChainedFilterSystem<true>());
+}
+
+inline void BenchmarkCompressedEntitySet()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 4000000;
+
+    auto run = [](const char* name, auto system) {
+        using SystemT = decltype(system);
+
+        World world;
+        world.RegisterComponent<benchmarks::Position>();
+        world.RegisterComponent<benchmarks::Velocity>();
+        world.CreateEntities(kNumEntities / 2, benchmarks::Position{});
+        world.CreateEntities(kNumEntities / 2, benchmarks::Position{}, benchmarks::Velocity{});
+        world.RegisterSystem<SystemT>();
+
+        RunBenchmark(name, 5, [&world]() { world.Run(); });
+        std::printf("%-60s %10zu KiB\n", "  query results", world.GetSystem<SystemT>().memory_usage / 1024);
+    };
+
+    run("Match x 2 + Intersection, 4M entities", benchmarks::IntersectionSystem<false>());
+    run("MatchCompressed x 2 + Intersection, 4M entities", benchmarks::IntersectionSystem<true>());
+}
+
+inline void BenchmarkParallelForEach()
+{
+    using namespace yecs;
+
+    constexpr std::size_t kNumEntities = 1000000;
+
+    auto max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (auto num_threads = 1u; num_threads <= max_threads; num_threads *= 2)
+    {
+        WorldConfig config;
+        config.num_threads = num_threads;
+
+        World world(config);
+        benchmarks::PopulatePhysicsWorld(world, kNumEntities);
+        world.RegisterSystem<benchmarks::ParallelPhysicsSystem>();
+
+        auto name = "Physics step 1M entities: ParallelForEach, " + std::to_string(num_threads) + " thread(s)";
+        RunBenchmark(name.c_str(), 5, [&world]() { world.Run(); });
+    }
+}
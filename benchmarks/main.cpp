@@ -0,0 +1,21 @@
+#include <iostream>
+
+#include "benchmarks/benchmarks.h"
+#include "yecs/yecs.h"
+
+int main(int argc, char** argv)
+{
+    BenchmarkComponentStorages();
+    BenchmarkEntityCreation();
+    BenchmarkBulkEntityCreation();
+    BenchmarkBulkEntityDestruction();
+    BenchmarkViews();
+    BenchmarkComponentAccess();
+    BenchmarkEntityQuery();
+    BenchmarkCachedQuery();
+    BenchmarkEntityPipeline();
+    BenchmarkCompressedEntitySet();
+    BenchmarkSoA();
+    BenchmarkParallelForEach();
+    return 0;
+}
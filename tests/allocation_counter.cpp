@@ -0,0 +1,55 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Global operator new is replaced to count heap allocations. Kept out of tests.h, so the compiler does not
+// inline the replacements into test code.
+thread_local size_t g_num_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++g_num_allocations;
+
+    if (auto p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++g_num_allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
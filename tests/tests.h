@@ -23,11 +23,23 @@ SOFTWARE.
 ****************************************************************************/
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "yecs/yecs.h"
 
+// Number of global heap allocations made by the calling thread, counted by operator new replaced in
+// allocation_counter.cpp.
+extern thread_local size_t g_num_allocations;
+
 class Test : public testing::Test
 {
 protected:
@@ -385,4 +397,2263 @@ TEST_F(Test, SimplePhysicsSystem)
             break;
         }
     }
-}
\ No newline at end of file
+}
+TEST_F(Test, DenseStorage)
+{
+    using namespace yecs;
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    DenseComponentStorage<Position> storage;
+
+    for (auto i = 0u; i < 10000u; ++i)
+    {
+        auto& position = storage.AddComponent(MakeEntity(i * 3, 0));
+        position.x     = static_cast<float>(i);
+    }
+
+    ASSERT_EQ(storage.size(), 10000u);
+    ASSERT_THROW(storage.AddComponent(MakeEntity(0, 0)), std::runtime_error);
+    ASSERT_FALSE(storage.HasComponent(MakeEntity(1, 0)));
+
+    for (auto i = 0u; i < 10000u; i += 2) { ASSERT_NO_THROW(storage.RemoveComponent(MakeEntity(i * 3, 0))); }
+
+    ASSERT_EQ(storage.size(), 5000u);
+    ASSERT_THROW(storage.RemoveComponent(MakeEntity(0, 0)), std::runtime_error);
+
+    for (auto i = 0u; i < 10000u; ++i)
+    {
+        ASSERT_EQ(storage.HasComponent(MakeEntity(i * 3, 0)), (i & 1) == 1);
+        if (i & 1)
+        {
+            ASSERT_EQ(storage.GetComponent(MakeEntity(i * 3, 0)).x, static_cast<float>(i));
+        }
+    }
+
+    for (auto i = 0u; i < storage.size(); ++i)
+    {
+        ASSERT_EQ(&storage.GetComponent(storage.entity(i)), &storage[i]);
+    }
+}
+
+struct DensePosition
+{
+    float x = 0.f;
+};
+
+TEST_F(Test, DenseStorageWorld)
+{
+    using namespace yecs;
+    World world;
+
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+
+    struct MoveSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& positions = access.Write<DensePosition>();
+            for (auto i = 0u; i < positions.size(); ++i) { positions[i].x += 1.f; }
+        }
+    };
+
+    std::vector<Entity> entities;
+    for (auto i = 0u; i < 256u; ++i)
+    {
+        entities.push_back(world.CreateEntity().AddComponent<DensePosition>().Build());
+    }
+
+    for (auto i = 0u; i < 256u; i += 2) { world.DestroyEntity(entities[i]); }
+
+    ASSERT_NO_THROW(world.RegisterSystem<MoveSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    ASSERT_EQ(world.GetNumComponents<DensePosition>(), 128u);
+    for (auto i = 1u; i < 256u; i += 2) { ASSERT_EQ(world.GetComponent<DensePosition>(entities[i]).x, 1.f); }
+}
+
+TEST_F(Test, EntityReuseLifo)
+{
+    using namespace yecs;
+    World world;
+
+    std::vector<Entity> entities;
+    for (auto i = 0u; i < 16u; ++i) { entities.push_back(world.CreateEntity().Build()); }
+
+    world.DestroyEntity(entities[3]);
+    world.DestroyEntity(entities[7]);
+    ASSERT_THROW(world.DestroyEntity(entities[7]), std::runtime_error);
+
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[7]));
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[3]));
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), 16u);
+}
+
+TEST_F(Test, EntityReuseFifo)
+{
+    using namespace yecs;
+    WorldConfig config;
+    config.entity_reuse_policy = EntityReusePolicy::kFifo;
+    World world(config);
+
+    std::vector<Entity> entities;
+    for (auto i = 0u; i < 16u; ++i) { entities.push_back(world.CreateEntity().Build()); }
+
+    world.DestroyEntity(entities[3]);
+    world.DestroyEntity(entities[7]);
+
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[3]));
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[7]));
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), 16u);
+
+    // Single indices keep their order after a batch destroy, batch indices follow from the highest one.
+    world.DestroyEntities(entities.data() + 8, 4);
+    world.DestroyEntity(entities[1]);
+    world.DestroyEntity(entities[2]);
+
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[1]));
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), GetEntityIndex(entities[2]));
+    for (auto i = 11u; i >= 8u; --i) { ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), i); }
+    ASSERT_EQ(GetEntityIndex(world.CreateEntity().Build()), 17u);
+}
+
+TEST_F(Test, GenerationalEntities)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+
+    auto e0 = world.CreateEntity().AddComponent<Position>().Build();
+    ASSERT_TRUE(world.IsAlive(e0));
+
+    world.DestroyEntity(e0);
+    ASSERT_FALSE(world.IsAlive(e0));
+
+    auto e1 = world.CreateEntity().Build();
+    ASSERT_EQ(GetEntityIndex(e0), GetEntityIndex(e1));
+    ASSERT_NE(e0, e1);
+    ASSERT_TRUE(world.IsAlive(e1));
+    ASSERT_FALSE(world.IsAlive(e0));
+    ASSERT_FALSE(world.HasComponent<Position>(e1));
+    ASSERT_THROW(world.DestroyEntity(e0), std::runtime_error);
+
+    // Exhaust slot generations, stale handles should never become alive again.
+    auto stale = world.CreateEntity().Build();
+    world.DestroyEntity(stale);
+
+    for (auto i = 0u; i < 1024u; ++i)
+    {
+        auto e = world.CreateEntity().Build();
+        ASSERT_NE(e, stale);
+        ASSERT_FALSE(world.IsAlive(stale));
+        world.DestroyEntity(e);
+    }
+}
+
+TEST_F(Test, ViewPhysicsSystem)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+        float y = 0.f;
+        float z = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 1.f;
+        float y = 1.f;
+        float z = 1.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+
+    struct PhysicsSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            constexpr float dt = 1.f;
+
+            access.View<Position, const Velocity>().ForEach([](Entity e, Position& pos, const Velocity& vel) {
+                pos.x += dt * vel.x;
+                pos.y += dt * vel.y;
+                pos.z += dt * vel.z;
+            });
+
+            for (auto [e, pos, vel] : access.View<DensePosition, const Velocity>()) { pos.x += dt * vel.x; }
+        }
+    };
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 256;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        switch (i & 0x3)
+        {
+        case 0:
+            entities.push_back(world.CreateEntity().AddComponent<Position>().AddComponent<DensePosition>().Build());
+            break;
+        case 1:
+            entities.push_back(world.CreateEntity().AddComponent<Position>().AddComponent<Velocity>().Build());
+            break;
+        case 2:
+            entities.push_back(world.CreateEntity().AddComponent<Velocity>().AddComponent<DensePosition>().Build());
+            break;
+        case 3:
+            entities.push_back(world.CreateEntity().AddComponent<Velocity>().Build());
+            break;
+        }
+    }
+
+    ASSERT_NO_THROW(world.RegisterSystem<PhysicsSystem>());
+
+    for (auto i = 0u; i < 10u; ++i) { ASSERT_NO_THROW(world.Run()); }
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        switch (i & 0x3)
+        {
+        case 0:
+            ASSERT_EQ(world.GetComponent<Position>(entities[i]).x, 0.f);
+            ASSERT_EQ(world.GetComponent<DensePosition>(entities[i]).x, 0.f);
+            break;
+        case 1:
+            ASSERT_EQ(world.GetComponent<Position>(entities[i]).x, 10.f);
+            ASSERT_EQ(world.GetComponent<Position>(entities[i]).z, 10.f);
+            break;
+        case 2:
+            ASSERT_EQ(world.GetComponent<DensePosition>(entities[i]).x, 10.f);
+            break;
+        }
+    }
+}
+
+TEST_F(Test, ParallelForEach)
+{
+    using namespace yecs;
+    WorldConfig config;
+    config.num_threads = 4;
+    World world(config);
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 1.f;
+    };
+
+    struct Counter
+    {
+        std::uint32_t count = 0;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<Counter>());
+
+    struct PhysicsSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            ParallelForEach(
+                subflow,
+                access.View<Position, const Velocity>(),
+                [](Entity e, Position& pos, const Velocity& vel) { pos.x += vel.x; },
+                64);
+        }
+    };
+
+    struct CountingSystem : public System
+    {
+        CountingSystem(std::atomic<std::uint32_t>& num_stale) : num_stale_(num_stale) {}
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            ParallelForEach(
+                subflow, access.Write<Counter>(), [](Entity e, Counter& counter) { ++counter.count; }, 64);
+
+            auto& velocities = access.Read<Velocity>();
+            auto& positions  = access.Read<Position>();
+            ParallelForEach(
+                subflow,
+                entity_query().Filter([&velocities](Entity e) { return velocities.HasComponent(e); }),
+                [&positions, &num_stale = num_stale_](Entity e) {
+                    // Physics system precedes this one, so positions should already be updated.
+                    if (positions.GetComponent(e).x < 1.f)
+                    {
+                        ++num_stale;
+                    }
+                },
+                64);
+        }
+
+        std::atomic<std::uint32_t>& num_stale_;
+    };
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 10000;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>().AddComponent<Counter>();
+        if (i & 1)
+        {
+            builder.AddComponent<Velocity>();
+        }
+        entities.push_back(builder.Build());
+    }
+
+    ASSERT_NO_THROW(world.RegisterSystem<PhysicsSystem>());
+    std::atomic<std::uint32_t> num_stale{0};
+    ASSERT_NO_THROW(world.RegisterSystem<CountingSystem>(num_stale));
+    ASSERT_NO_THROW((world.Precede<PhysicsSystem, CountingSystem>()));
+
+    for (auto i = 0u; i < 10u; ++i) { ASSERT_NO_THROW(world.Run()); }
+
+    ASSERT_EQ(num_stale.load(), 0u);
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        ASSERT_EQ(world.GetComponent<Position>(entities[i]).x, (i & 1) ? 10.f : 0.f);
+        ASSERT_EQ(world.GetComponent<Counter>(entities[i]).count, 10u);
+    }
+}
+
+struct ArchetypePosition
+{
+    float x = 0.f;
+    float y = 0.f;
+};
+
+struct ArchetypeVelocity
+{
+    float x = 1.f;
+    float y = 1.f;
+};
+
+struct ArchetypeName
+{
+    std::string name = "entity";
+};
+
+namespace yecs
+{
+template <>
+struct ComponentStorageTraits<ArchetypePosition>
+{
+    using StorageType = ArchetypeComponentStorage<ArchetypePosition>;
+};
+
+template <>
+struct ComponentStorageTraits<ArchetypeVelocity>
+{
+    using StorageType = ArchetypeComponentStorage<ArchetypeVelocity>;
+};
+
+template <>
+struct ComponentStorageTraits<ArchetypeName>
+{
+    using StorageType = ArchetypeComponentStorage<ArchetypeName>;
+};
+}  // namespace yecs
+
+TEST_F(Test, ArchetypeStorage)
+{
+    using namespace yecs;
+    World world;
+
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeVelocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeName>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+
+    // Read-only views can be built from a const table, writing views need a mutable one.
+    static_assert(std::is_constructible_v<ArchetypeView<const ArchetypePosition>, const ArchetypeTable&>);
+    static_assert(!std::is_constructible_v<ArchetypeView<ArchetypePosition>, const ArchetypeTable&>);
+    static_assert(std::is_constructible_v<ArchetypeView<ArchetypePosition>, ArchetypeTable&>);
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 4096u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<ArchetypePosition>().AddComponent<DensePosition>();
+        world.GetComponent<ArchetypePosition>(builder.Build()).x = static_cast<float>(i);
+        if (i & 1)
+        {
+            builder.AddComponent<ArchetypeVelocity>();
+        }
+        if (i & 2)
+        {
+            builder.AddComponent<ArchetypeName>();
+            world.GetComponent<ArchetypeName>(builder.Build()).name = std::to_string(i);
+        }
+        entities.push_back(builder.Build());
+    }
+
+    ASSERT_EQ(world.GetNumComponents<ArchetypePosition>(), kNumEntities);
+    ASSERT_EQ(world.GetNumComponents<ArchetypeVelocity>(), kNumEntities / 2);
+    ASSERT_THROW(world.AddComponent<ArchetypePosition>(entities[0]), std::runtime_error);
+
+    // Migrate entities back and forth.
+    for (auto i = 0u; i < kNumEntities; i += 4)
+    {
+        world.RemoveComponent<ArchetypeName>(entities[i + 3]);
+        world.AddComponent<ArchetypeName>(entities[i]).name = std::to_string(i);
+    }
+
+    for (auto i = 0u; i < kNumEntities; i += 8) { world.DestroyEntity(entities[i + 1]); }
+
+    struct PhysicsSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            access.ArchetypeView<ArchetypePosition, const ArchetypeVelocity>().ForEachChunk(
+                [](size_t count, const Entity* entities, ArchetypePosition* pos, const ArchetypeVelocity* vel) {
+                    for (auto i = 0u; i < count; ++i) { pos[i].y += vel[i].y; }
+                });
+
+            ParallelForEach(subflow,
+                            access.ArchetypeView<ArchetypePosition, const ArchetypeName>(),
+                            [](Entity e, ArchetypePosition& pos, const ArchetypeName& name) {
+                                pos.y += static_cast<float>(std::stoi(name.name));
+                            });
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<PhysicsSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        if ((i & 7) == 1)
+        {
+            ASSERT_FALSE(world.IsAlive(entities[i]));
+            continue;
+        }
+
+        auto  has_name  = (i & 3) == 0 || (i & 3) == 2;
+        auto& position = world.GetComponent<ArchetypePosition>(entities[i]);
+
+        ASSERT_EQ(position.x, static_cast<float>(i));
+        ASSERT_EQ(position.y, ((i & 1) ? 1.f : 0.f) + (has_name ? static_cast<float>(i) : 0.f));
+        ASSERT_EQ(world.HasComponent<ArchetypeName>(entities[i]), has_name);
+        ASSERT_TRUE(world.HasComponent<DensePosition>(entities[i]));
+    }
+}
+
+TEST_F(Test, ArchetypeChunks)
+{
+    using namespace yecs;
+
+    // Counts chunk allocations.
+    struct CountingResource : public std::pmr::memory_resource
+    {
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            ++num_allocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& rhs) const noexcept override { return this == &rhs; }
+
+        size_t num_allocations = 0;
+    };
+
+    CountingResource resource;
+    ArchetypeTable   table(&resource);
+    auto             bit = table.RegisterComponent<ArchetypePosition>();
+
+    auto add = [&table, bit](Entity entity) {
+        table.AddComponent(entity, bit, [](void* ptr) { new (ptr) ArchetypePosition(); });
+    };
+
+    // Fill exactly one chunk.
+    add(MakeEntity(0, 0));
+    auto& archetype = *table.archetypes().front();
+    auto  capacity  = archetype.chunk_capacity();
+    for (auto i = 1u; i < capacity; ++i) { add(MakeEntity(i, 0)); }
+    ASSERT_EQ(archetype.num_chunks(), 1u);
+
+    // Oscillating around the chunk boundary keeps the spare chunk instead of reallocating it.
+    add(MakeEntity(static_cast<EntityIndex>(capacity), 0));
+    table.DestroyEntity(MakeEntity(static_cast<EntityIndex>(capacity), 0));
+
+    auto before = resource.num_allocations;
+    for (auto i = 0u; i < 10; ++i)
+    {
+        add(MakeEntity(static_cast<EntityIndex>(capacity), 0));
+        ASSERT_EQ(archetype.num_chunks(), 2u);
+        ASSERT_EQ(archetype.chunk_size(1), 1u);
+        table.DestroyEntity(MakeEntity(static_cast<EntityIndex>(capacity), 0));
+        ASSERT_EQ(archetype.num_chunks(), 1u);
+    }
+    ASSERT_EQ(resource.num_allocations, before);
+
+    for (auto i = 0u; i < capacity; ++i) { table.DestroyEntity(MakeEntity(i, 0)); }
+    ASSERT_EQ(archetype.num_chunks(), 0u);
+    ASSERT_EQ(table.GetNumComponents(bit), 0u);
+
+    // Bulk creation places entities into their final archetype without intermediate ones.
+    World world;
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeVelocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeName>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+
+    ArchetypeName name;
+    name.name    = "bullet";
+    auto bullets = world.CreateEntities(1000, ArchetypePosition{}, ArchetypeVelocity{}, name, DensePosition{});
+    world.GetComponent<ArchetypePosition>(bullets[0]).x = 1.f;
+    auto clones = world.CreateEntities(1000, bullets[0]);
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            ASSERT_EQ(access.ArchetypeView<ArchetypePosition>().table().archetypes().size(), 1u);
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    for (auto entity : clones)
+    {
+        ASSERT_EQ(world.GetComponent<ArchetypePosition>(entity).x, 1.f);
+        ASSERT_EQ(world.GetComponent<ArchetypeName>(entity).name, "bullet");
+        ASSERT_TRUE(world.HasComponent<ArchetypeVelocity>(entity));
+        ASSERT_TRUE(world.HasComponent<DensePosition>(entity));
+    }
+    ASSERT_EQ(world.GetNumComponents<ArchetypePosition>(), 2000u);
+    ASSERT_EQ(world.GetNumComponents<ArchetypeName>(), 2000u);
+}
+
+struct LoggingSystem : public yecs::System
+{
+    LoggingSystem(std::mutex& mutex, std::vector<int>& order, int id) : mutex_(mutex), order_(order), id_(id) {}
+
+    void Run(yecs::ComponentAccess& access, yecs::EntityQuery& entity_query, tf::Subflow& subflow) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        order_.push_back(id_);
+    }
+
+    std::mutex&       mutex_;
+    std::vector<int>& order_;
+    int               id_;
+};
+
+struct IntegrateSystem : public LoggingSystem
+{
+    using LoggingSystem::LoggingSystem;
+    using Reads  = yecs::ComponentTypesBuilder<ArchetypeVelocity>;
+    using Writes = yecs::ComponentTypesBuilder<ArchetypePosition>;
+};
+
+struct RenderSystem : public LoggingSystem
+{
+    using LoggingSystem::LoggingSystem;
+    using Reads = yecs::ComponentTypesBuilder<ArchetypePosition>;
+};
+
+struct ResetSystem : public LoggingSystem
+{
+    using LoggingSystem::LoggingSystem;
+    using Writes = yecs::ComponentTypesBuilder<ArchetypePosition, ArchetypeVelocity>;
+};
+
+TEST_F(Test, SystemDependencyInference)
+{
+    using namespace yecs;
+    World world;
+
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeVelocity>());
+
+    std::mutex       mutex;
+    std::vector<int> order;
+
+    ASSERT_NO_THROW(world.RegisterSystem<IntegrateSystem>(mutex, order, 0));
+    ASSERT_NO_THROW(world.RegisterSystem<RenderSystem>(mutex, order, 1));
+    ASSERT_NO_THROW(world.RegisterSystem<ResetSystem>(mutex, order, 2));
+
+    // Inferred order is IntegrateSystem -> RenderSystem -> ResetSystem, explicit precedence overrides it
+    // without introducing a cycle.
+    ASSERT_NO_THROW((world.Precede<ResetSystem, IntegrateSystem>()));
+
+    for (auto i = 0u; i < 2; ++i)
+    {
+        order.clear();
+        ASSERT_NO_THROW(world.Run());
+        ASSERT_EQ(order, (std::vector<int>{2, 0, 1}));
+    }
+}
+
+TEST_F(Test, CommandBuffers)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 1024u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto entity = world.CreateEntity().AddComponent<Position>().Build();
+        world.GetComponent<Position>(entity).x = static_cast<float>(i);
+        entities.push_back(entity);
+    }
+
+    // Spawns an entity with velocity for every even entity and destroys odd ones.
+    struct SpawnSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            ParallelForEach(subflow, access.View<const Position>(), [access](Entity e, const Position& pos) mutable {
+                auto& commands = access.Commands();
+                auto  index    = static_cast<unsigned>(pos.x);
+
+                if (index & 1)
+                {
+                    commands.DestroyEntity(e);
+                    // Commands for entities destroyed in the same frame are discarded.
+                    commands.AddComponent<Velocity>(e);
+                    commands.DestroyEntity(e);
+                    return;
+                }
+
+                auto spawned = commands.CreateEntity();
+                commands.AddComponent<Position>(spawned, pos);
+                commands.AddComponent<Velocity>(spawned, Velocity{pos.x});
+                // Remove and re-add is applied in recording order.
+                commands.RemoveComponent<Position>(spawned);
+                commands.AddComponent<Position>(spawned, Position{-pos.x});
+                commands.AddComponent<Velocity>(e, Velocity{static_cast<float>(spawned)});
+            });
+        }
+    };
+
+    // Checks that nothing is applied before the systems finish.
+    struct CheckSystem : public System
+    {
+        explicit CheckSystem(std::atomic<size_t>& num_positions) : num_positions_(num_positions) {}
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            num_positions_ = access.Read<Position>().size() + access.Read<Velocity>().size();
+        }
+
+        std::atomic<size_t>& num_positions_;
+    };
+
+    std::atomic<size_t> num_components = 0;
+
+    ASSERT_NO_THROW(world.RegisterSystem<SpawnSystem>());
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>(num_components));
+    ASSERT_NO_THROW((world.Precede<SpawnSystem, CheckSystem>()));
+    ASSERT_NO_THROW(world.Run());
+
+    ASSERT_EQ(num_components.load(), kNumEntities);
+    ASSERT_EQ(world.GetNumComponents<Position>(), kNumEntities);
+    ASSERT_EQ(world.GetNumComponents<Velocity>(), kNumEntities);
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        if (i & 1)
+        {
+            ASSERT_FALSE(world.IsAlive(entities[i]));
+            continue;
+        }
+
+        auto spawned = static_cast<Entity>(world.GetComponent<Velocity>(entities[i]).x);
+        ASSERT_TRUE(world.IsAlive(spawned));
+        ASSERT_EQ(world.GetComponent<Position>(spawned).x, -static_cast<float>(i));
+        ASSERT_EQ(world.GetComponent<Velocity>(spawned).x, static_cast<float>(i));
+    }
+}
+
+TEST_F(Test, CommandBufferChurn)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+
+    static constexpr size_t kNumEntities = 1000;
+
+    // Replaces every entity with a new one each frame.
+    struct ChurnSystem : public System
+    {
+        explicit ChurnSystem(std::vector<Entity>& spawned) : spawned_(spawned) {}
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& commands = access.Commands();
+            for (auto entity : spawned_) { commands.DestroyEntity(entity); }
+
+            spawned_.clear();
+            for (auto i = 0u; i < kNumEntities; ++i)
+            {
+                auto entity = commands.CreateEntity();
+                commands.AddComponent<Position>(entity, Position{static_cast<float>(i)});
+                spawned_.push_back(entity);
+            }
+        }
+
+        std::vector<Entity>& spawned_;
+    };
+
+    std::vector<Entity> spawned;
+    ASSERT_NO_THROW(world.RegisterSystem<ChurnSystem>(spawned));
+
+    std::vector<Entity> previous;
+    for (auto frame = 0u; frame < 100; ++frame)
+    {
+        ASSERT_NO_THROW(world.Run());
+        ASSERT_EQ(spawned.size(), kNumEntities);
+        ASSERT_EQ(world.GetNumComponents<Position>(), kNumEntities);
+
+        // Slots destroyed in a frame are reused by the next one, stale handles stay dead.
+        for (auto i = 0u; i < spawned.size(); ++i)
+        {
+            ASSERT_TRUE(world.IsAlive(spawned[i]));
+            ASSERT_LT(GetEntityIndex(spawned[i]), 2 * kNumEntities);
+            ASSERT_EQ(world.GetComponent<Position>(spawned[i]).x, static_cast<float>(i));
+        }
+        for (auto entity : previous) { ASSERT_FALSE(world.IsAlive(entity)); }
+
+        previous = spawned;
+    }
+}
+
+TEST_F(Test, ComponentTypeIds)
+{
+    using namespace yecs;
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    struct Velocity
+    {
+        float x, y, z;
+    };
+
+    auto position = GetComponentTypeId<Position>();
+    auto velocity = GetComponentTypeId<Velocity>();
+
+    ASSERT_NE(position, velocity);
+    ASSERT_EQ(position, GetComponentTypeId<const Position>());
+    ASSERT_EQ(velocity, GetComponentTypeId<Velocity>());
+    ASSERT_EQ((ComponentTypesBuilder<Position, Velocity>().Build()), (ComponentTypes{position, velocity}));
+}
+
+TEST_F(Test, EntityBitset)
+{
+    using namespace yecs;
+
+    EntityBitset bitset;
+    bitset.resize(100000);
+
+    std::vector<EntityIndex> expected;
+    for (EntityIndex i = 0; i < 100000; i += 997) { expected.push_back(i); }
+    expected.push_back(63);
+    expected.push_back(64);
+    expected.push_back(4095);
+    expected.push_back(4096);
+    std::sort(expected.begin(), expected.end());
+
+    for (auto index : expected)
+    {
+        bitset.set(index);
+        bitset.set(index);
+    }
+
+    ASSERT_EQ(bitset.count(), expected.size());
+    ASSERT_TRUE(bitset.test(4095));
+    ASSERT_FALSE(bitset.test(4094));
+
+    std::vector<EntityIndex> indices;
+    bitset.ForEach([&indices](EntityIndex index) { indices.push_back(index); });
+    ASSERT_EQ(indices, expected);
+
+    for (auto index : expected) { bitset.reset(index); }
+
+    indices.clear();
+    bitset.ForEach([&indices](EntityIndex index) { indices.push_back(index); });
+    ASSERT_TRUE(indices.empty());
+    ASSERT_EQ(bitset.count(), 0u);
+}
+
+TEST_F(Test, ComponentMasks)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    struct Unregistered
+    {
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypePosition>());
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 1000u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>().AddComponent<ArchetypePosition>();
+        if (i % 3 == 0)
+        {
+            builder.AddComponent<Velocity>();
+        }
+        entities.push_back(builder.Build());
+    }
+
+    for (auto i = 0u; i < kNumEntities; i += 6) { world.RemoveComponent<Position>(entities[i]); }
+    for (auto i = 1u; i < kNumEntities; i += 6) { world.DestroyEntity(entities[i]); }
+
+    // Every 6th entity has velocity only, every 3rd one has both.
+    ASSERT_EQ(world.GetNumComponents<Position>(), kNumEntities - 2 * ((kNumEntities + 5) / 6));
+    ASSERT_EQ(world.GetNumComponents<ArchetypePosition>(), kNumEntities - (kNumEntities + 4) / 6);
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto moving = entity_query.WithComponents<Position, const Velocity>();
+            for (auto e : moving.entities()) { ASSERT_EQ(GetEntityIndex(e) % 6, 3u); }
+            ASSERT_EQ(moving.entities().size(), 167u);
+
+            auto filtered = entity_query().Filter(entity_query.HasComponents<Position, Velocity>()).entities();
+            std::sort(filtered.begin(), filtered.end());
+            ASSERT_EQ(filtered, moving.entities());
+
+            ASSERT_THROW(entity_query.WithComponents<Unregistered>(), std::runtime_error);
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+}
+
+struct SoABody
+{
+    float x  = 0.f;
+    float y  = 0.f;
+    float vx = 1.f;
+    float vy = 2.f;
+};
+
+namespace yecs
+{
+template <>
+struct SoAFields<SoABody> : SoAFieldList<&SoABody::x, &SoABody::y, &SoABody::vx, &SoABody::vy>
+{
+};
+
+template <>
+struct ComponentStorageTraits<SoABody>
+{
+    using StorageType = SoAComponentStorage<SoABody>;
+};
+}  // namespace yecs
+
+TEST_F(Test, SoAComponentStorage)
+{
+    using namespace yecs;
+    World world;
+
+    ASSERT_NO_THROW(world.RegisterComponent<SoABody>());
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 1000u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto entity = world.CreateEntity().AddComponent<SoABody>().Build();
+        world.GetComponent<SoABody>(entity).get<&SoABody::x>() = static_cast<float>(i);
+        entities.push_back(entity);
+    }
+
+    for (auto i = 0u; i < kNumEntities; i += 2) { world.DestroyEntity(entities[i]); }
+
+    struct IntegrateSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& bodies = access.Write<SoABody>();
+            auto  x      = bodies.data<&SoABody::x>();
+            auto  y      = bodies.data<&SoABody::y>();
+            auto  vx     = bodies.data<&SoABody::vx>();
+            auto  vy     = bodies.data<&SoABody::vy>();
+
+            ASSERT_EQ(reinterpret_cast<std::uintptr_t>(x) % kSoAAlignment, 0u);
+
+            for (auto i = 0u; i < bodies.size(); ++i)
+            {
+                x[i] += vx[i];
+                y[i] += vy[i];
+            }
+
+            auto& commands = access.Commands();
+            for (auto i = 0u; i < bodies.size(); ++i)
+            {
+                if (static_cast<unsigned>(x[i]) % 4 == 0)
+                {
+                    commands.AddComponent<SoABody>(bodies.entity(i), SoABody{0.f, 0.f, 0.f, 0.f});
+                }
+            }
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<IntegrateSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    ASSERT_EQ(world.GetNumComponents<SoABody>(), kNumEntities / 2);
+
+    for (auto i = 1u; i < kNumEntities; i += 2)
+    {
+        SoABody body = world.GetComponent<SoABody>(entities[i]);
+
+        if ((i + 1) % 4 == 0)
+        {
+            ASSERT_EQ(body.x, 0.f);
+            ASSERT_EQ(body.vx, 0.f);
+        }
+        else
+        {
+            ASSERT_EQ(body.x, static_cast<float>(i) + 1.f);
+            ASSERT_EQ(body.y, 2.f);
+            ASSERT_EQ(body.vy, 2.f);
+        }
+    }
+}
+
+TEST_F(Test, PagedComponentStorage)
+{
+    using namespace yecs;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    PagedComponentStorage<Position, 64> storage;
+    storage.Reserve(100);
+    ASSERT_EQ(storage.capacity(), 128u);
+
+    std::vector<Position*> addresses;
+
+    constexpr auto kNumEntities = 1000u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto& position = storage.AddComponent(MakeEntity(i, 0));
+        position.x     = static_cast<float>(i);
+        addresses.push_back(&position);
+    }
+
+    // Removing components does not move remaining ones, freed slots are reused.
+    for (auto i = 0u; i < kNumEntities; i += 3) { storage.RemoveComponent(MakeEntity(i, 0)); }
+    for (auto i = 0u; i < kNumEntities; i += 3) { storage.AddComponent(MakeEntity(kNumEntities + i, 0)); }
+
+    ASSERT_EQ(storage.size(), kNumEntities + 0u);
+    ASSERT_EQ(storage.capacity(), 1024u);
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        if (i % 3)
+        {
+            ASSERT_EQ(&storage.GetComponent(MakeEntity(i, 0)), addresses[i]);
+            ASSERT_EQ(addresses[i]->x, static_cast<float>(i));
+        }
+        else
+        {
+            ASSERT_FALSE(storage.HasComponent(MakeEntity(i, 0)));
+        }
+    }
+
+    for (auto i = 0u; i < storage.size(); ++i) { ASSERT_EQ(&storage.GetComponent(storage.entity(i)), &storage[i]); }
+}
+
+TEST_F(Test, TagStorage)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Selected
+    {
+    };
+
+    struct Frozen
+    {
+    };
+
+    static_assert(std::is_same_v<ComponentStorageType<Selected>, TagStorage<Selected>>);
+    static_assert(std::is_same_v<ComponentStorageType<Position>, DenseComponentStorage<Position>>);
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Selected>());
+    ASSERT_NO_THROW(world.RegisterComponent<Frozen>());
+
+    std::vector<Entity> entities;
+
+    constexpr auto kNumEntities = 1000u;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>();
+        if (i % 2 == 0)
+        {
+            builder.AddComponent<Selected>();
+        }
+        if (i % 3 == 0)
+        {
+            builder.AddComponent<Frozen>();
+        }
+        world.GetComponent<Position>(builder.Build()).x = static_cast<float>(i);
+        entities.push_back(builder.Build());
+    }
+
+    ASSERT_EQ(world.GetNumComponents<Selected>(), kNumEntities / 2);
+    ASSERT_TRUE(world.HasComponent<Selected>(entities[0]));
+    ASSERT_FALSE(world.HasComponent<Selected>(entities[1]));
+    ASSERT_THROW(world.AddComponent<Selected>(entities[0]), std::runtime_error);
+
+    world.RemoveComponent<Selected>(entities[0]);
+    world.DestroyEntity(entities[6]);
+    ASSERT_FALSE(world.HasComponent<Selected>(entities[0]));
+    ASSERT_EQ(world.GetNumComponents<Selected>(), kNumEntities / 2 - 2);
+    ASSERT_EQ(world.GetNumComponents<Frozen>(), (kNumEntities + 2) / 3 - 1);
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            // Every 6th entity is both selected and frozen.
+            auto both = entity_query.WithComponents<Selected, Frozen>().entities();
+            for (auto e : both) { ASSERT_EQ(GetEntityIndex(e) % 6, 0u); }
+            ASSERT_EQ(both.size(), 165u);
+
+            // Tags never drive views, positions are iterated and the tag is tested.
+            auto count = 0u;
+            access.View<const Position, const Selected>().ForEach(
+                [&count](Entity, const Position& position, const Selected&) {
+                    ASSERT_EQ(static_cast<unsigned>(position.x) % 2, 0u);
+                    ++count;
+                });
+            ASSERT_EQ(count, 498u);
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+}
+
+TEST_F(Test, CreateEntities)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Selected
+    {
+    };
+
+    struct Unique
+    {
+        std::unique_ptr<int> value;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Selected>());
+    ASSERT_NO_THROW(world.RegisterComponent<Unique>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeName>());
+    ASSERT_NO_THROW(world.RegisterComponent<SoABody>());
+
+    // A single destroyed index can not hold the batch, so it takes fresh indices.
+    auto lonely = world.CreateEntity().Build();
+    world.DestroyEntity(lonely);
+
+    constexpr auto kNumEntities = 10000u;
+    auto           entities =
+        world.CreateEntities(kNumEntities, Position{1.f}, Selected{}, DensePosition{2.f}, SoABody{3.f, 4.f});
+
+    ASSERT_EQ(entities.size(), kNumEntities);
+    ASSERT_EQ(entities.first(), 1u);
+    ASSERT_EQ(world.GetNumComponents<Position>(), kNumEntities);
+    ASSERT_EQ(world.GetNumComponents<Selected>(), kNumEntities);
+
+    for (auto entity : entities)
+    {
+        ASSERT_TRUE(world.IsAlive(entity));
+        ASSERT_EQ(world.GetComponent<Position>(entity).x, 1.f);
+        ASSERT_EQ(world.GetComponent<DensePosition>(entity).x, 2.f);
+        ASSERT_EQ(world.GetComponent<SoABody>(entity).get<&SoABody::y>(), 4.f);
+        ASSERT_TRUE(world.HasComponent<Selected>(entity));
+    }
+
+    // Clone an entity having components in every kind of storage.
+    auto source = entities[42];
+    world.GetComponent<Position>(source).x = 5.f;
+    world.AddComponent<ArchetypeName>(source).name = "clone";
+
+    auto clones = world.CreateEntities(kNumEntities, source);
+    ASSERT_EQ(clones.first(), kNumEntities + 1);
+    ASSERT_EQ(world.GetNumComponents<Position>(), 2 * kNumEntities);
+    ASSERT_EQ(world.GetNumComponents<ArchetypeName>(), kNumEntities + 1);
+
+    for (auto entity : clones)
+    {
+        ASSERT_EQ(world.GetComponent<Position>(entity).x, 5.f);
+        ASSERT_EQ(world.GetComponent<SoABody>(entity).get<&SoABody::x>(), 3.f);
+        ASSERT_EQ(world.GetComponent<ArchetypeName>(entity).name, "clone");
+        ASSERT_TRUE(world.HasComponent<Selected>(entity));
+    }
+
+    // Empty batches are valid and create nothing.
+    ASSERT_TRUE(world.CreateEntities(0, Position{1.f}, Selected{}, DensePosition{2.f}).empty());
+    ASSERT_TRUE(world.CreateEntities(0, source).empty());
+    ASSERT_EQ(world.GetNumComponents<Position>(), 2 * kNumEntities);
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto named = entity_query.WithComponents<Position, Selected, ArchetypeName>().entities();
+            ASSERT_EQ(named.size(), kNumEntities + 1);
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    // Entities with components which can not be copied are not cloned.
+    auto unique = world.CreateEntity().AddComponent<Position>().AddComponent<Unique>().Build();
+    ASSERT_THROW(world.CreateEntities(10, unique), std::runtime_error);
+    ASSERT_EQ(world.GetNumComponents<Position>(), 2 * kNumEntities + 1);
+    ASSERT_EQ(world.GetNumComponents<Unique>(), 1u);
+}
+
+TEST_F(Test, DestroyEntities)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Selected
+    {
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Selected>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<SoABody>());
+
+    constexpr auto kNumEntities = 1000u;
+    auto entities = world.CreateEntities(kNumEntities, Position{}, Selected{}, DensePosition{}, SoABody{});
+
+    std::vector<Entity> doomed;
+    for (auto entity : entities)
+    {
+        auto index = static_cast<float>(GetEntityIndex(entity));
+        world.GetComponent<Position>(entity).x          = index;
+        world.GetComponent<DensePosition>(entity).x = index;
+        world.GetComponent<SoABody>(entity) = SoABody{index, index, 0.f, 0.f};
+        world.AddComponent<ArchetypePosition>(entity).x = index;
+
+        if (GetEntityIndex(entity) % 3 != 1)
+        {
+            doomed.push_back(entity);
+        }
+    }
+
+    // Failed batches do not destroy anything.
+    auto repeated = doomed;
+    repeated.push_back(doomed.front());
+    ASSERT_THROW(world.DestroyEntities(repeated), std::runtime_error);
+    ASSERT_TRUE(world.IsAlive(doomed.front()));
+
+    ASSERT_NO_THROW(world.DestroyEntities(doomed));
+    ASSERT_THROW(world.DestroyEntities(doomed.data(), 1), std::runtime_error);
+
+    constexpr auto kNumSurvivors = kNumEntities / 3;
+    ASSERT_EQ(world.GetNumComponents<Position>(), kNumSurvivors);
+    ASSERT_EQ(world.GetNumComponents<Selected>(), kNumSurvivors);
+    ASSERT_EQ(world.GetNumComponents<DensePosition>(), kNumSurvivors);
+    ASSERT_EQ(world.GetNumComponents<ArchetypePosition>(), kNumSurvivors);
+    ASSERT_EQ(world.GetNumComponents<SoABody>(), kNumSurvivors);
+
+    for (auto entity : entities)
+    {
+        auto index = static_cast<float>(GetEntityIndex(entity));
+        if (GetEntityIndex(entity) % 3 != 1)
+        {
+            ASSERT_FALSE(world.IsAlive(entity));
+            continue;
+        }
+
+        ASSERT_EQ(world.GetComponent<Position>(entity).x, index);
+        ASSERT_EQ(world.GetComponent<DensePosition>(entity).x, index);
+        ASSERT_EQ(world.GetComponent<SoABody>(entity).get<&SoABody::y>(), index);
+        ASSERT_EQ(world.GetComponent<ArchetypePosition>(entity).x, index);
+        ASSERT_TRUE(world.HasComponent<Selected>(entity));
+    }
+
+    // Paged storage keeps the remaining components in place.
+    PagedComponentStorage<Position, 64> storage;
+    std::vector<Position*>              addresses;
+    for (auto entity : entities) { addresses.push_back(&storage.AddComponent(entity)); }
+    storage.RemoveComponents(doomed.data(), doomed.size());
+
+    ASSERT_EQ(storage.size(), kNumSurvivors);
+    for (auto i = 0u; i < storage.size(); ++i)
+    {
+        ASSERT_EQ(&storage[i], addresses[GetEntityIndex(storage.entity(i))]);
+        ASSERT_EQ(GetEntityIndex(storage.entity(i)) % 3, 1u);
+    }
+}
+
+TEST_F(Test, EntityBursts)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+
+    // Spawning and despawning bursts reuses destroyed runs instead of generating fresh indices.
+    constexpr auto kBurstSize = 10000u;
+    EntityRange    previous;
+    for (auto burst = 0u; burst < 100; ++burst)
+    {
+        auto entities = world.CreateEntities(kBurstSize, Position{1.f}, DensePosition{});
+        ASSERT_EQ(entities.size(), kBurstSize);
+        ASSERT_LE(GetEntityIndex(entities[kBurstSize - 1]), kBurstSize);
+        ASSERT_EQ(world.GetNumComponents<Position>(), kBurstSize);
+
+        for (auto entity : entities)
+        {
+            ASSERT_TRUE(world.IsAlive(entity));
+            ASSERT_EQ(world.GetComponent<Position>(entity).x, 1.f);
+        }
+
+        // Stale handles of the previous burst do not alias the new one.
+        for (auto entity : previous) { ASSERT_FALSE(world.IsAlive(entity)); }
+
+        // Keep one entity every other burst, so the run is split.
+        std::vector<Entity> doomed(entities.begin(), entities.end());
+        if (burst % 2 == 1)
+        {
+            world.DestroyEntity(doomed.back());
+        }
+        doomed.pop_back();
+        if (burst % 2 == 0)
+        {
+            doomed.push_back(entities[kBurstSize - 1]);
+        }
+
+        ASSERT_NO_THROW(world.DestroyEntities(doomed));
+        ASSERT_EQ(world.GetNumComponents<Position>(), 0u);
+        previous = entities;
+    }
+
+    // Single entities reuse destroyed runs too.
+    auto entity = world.CreateEntity().Build();
+    ASSERT_LE(GetEntityIndex(entity), kBurstSize);
+
+    // Interleaved batches are merged into a single run.
+    World interleaved;
+    ASSERT_NO_THROW(interleaved.RegisterComponent<Position>());
+
+    auto                entities = interleaved.CreateEntities(kBurstSize, Position{});
+    std::vector<Entity> even, odd;
+    for (auto entity : entities) { (GetEntityIndex(entity) % 2 == 0 ? even : odd).push_back(entity); }
+
+    ASSERT_NO_THROW(interleaved.DestroyEntities(even));
+    ASSERT_NO_THROW(interleaved.DestroyEntities(odd));
+
+    auto reused = interleaved.CreateEntities(kBurstSize, Position{});
+    ASSERT_EQ(reused.first(), 0u);
+    for (auto entity : entities) { ASSERT_FALSE(interleaved.IsAlive(entity)); }
+    for (auto entity : reused) { ASSERT_TRUE(interleaved.IsAlive(entity)); }
+}
+
+// Heavy component without default constructor, counts copies.
+struct Mesh
+{
+    Mesh(std::string name, size_t num_vertices) : name(std::move(name)), vertices(num_vertices, 0.f) {}
+
+    Mesh(const Mesh& rhs) : name(rhs.name), vertices(rhs.vertices) { ++num_copies; }
+    Mesh& operator=(const Mesh& rhs)
+    {
+        name     = rhs.name;
+        vertices = rhs.vertices;
+        ++num_copies;
+        return *this;
+    }
+
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+
+    std::string        name;
+    std::vector<float> vertices;
+
+    static inline int num_copies = 0;
+};
+
+TEST_F(Test, EmplaceComponent)
+{
+    using namespace yecs;
+    World world;
+
+    ASSERT_NO_THROW(world.RegisterComponent<Mesh>());
+    ASSERT_NO_THROW(world.RegisterComponent<DensePosition>());
+    ASSERT_NO_THROW(world.RegisterComponent<ArchetypeName>());
+
+    Mesh::num_copies = 0;
+
+    auto e0 = world.CreateEntity()
+                  .AddComponent<Mesh>("cube", 8u)
+                  .AddComponent<DensePosition>(DensePosition{2.f})
+                  .AddComponent<ArchetypeName>(ArchetypeName{"cube"})
+                  .Build();
+
+    ASSERT_EQ(world.GetComponent<Mesh>(e0).name, "cube");
+    ASSERT_EQ(world.GetComponent<Mesh>(e0).vertices.size(), 8u);
+    ASSERT_EQ(world.GetComponent<DensePosition>(e0).x, 2.f);
+    ASSERT_EQ(world.GetComponent<ArchetypeName>(e0).name, "cube");
+
+    // Prebuilt values are moved in, lvalues are copied once.
+    Mesh sphere("sphere", 100u);
+    auto e1 = world.CreateEntity().Build();
+    auto e2 = world.CreateEntity().Build();
+    world.EmplaceComponent<Mesh>(e1, std::move(sphere));
+    world.EmplaceComponent<Mesh>(e2, world.GetComponent<Mesh>(e1));
+    ASSERT_EQ(Mesh::num_copies, 1);
+    ASSERT_EQ(world.GetComponent<Mesh>(e2).vertices.size(), 100u);
+    ASSERT_THROW(world.EmplaceComponent<Mesh>(e2, "again", 1u), std::runtime_error);
+
+    // Structural changes recorded by systems are moved into storages as well.
+    struct SpawnSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& commands = access.Commands();
+            commands.AddComponent<Mesh>(commands.CreateEntity(), Mesh("spawned", 3u));
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<SpawnSystem>());
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(world.GetNumComponents<Mesh>(), 4u);
+    ASSERT_EQ(Mesh::num_copies, 1);
+
+    PagedComponentStorage<Mesh> storage;
+    ASSERT_EQ(storage.EmplaceComponent(e0, "paged", 2u).vertices.size(), 2u);
+    ASSERT_EQ(Mesh::num_copies, 1);
+}
+
+TEST_F(Test, ChangeTracking)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+
+    auto entities = world.CreateEntities(10, Position{});
+    ASSERT_EQ(world.GetTick(), 0u);
+
+    struct TrackingSystem : public System
+    {
+        TrackingSystem(EntityRange entities, std::vector<std::pair<size_t, size_t>>& counts)
+            : entities_(entities), counts_(counts)
+        {
+        }
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto added   = entity_query.Added<Position>(last_tick_).entities();
+            auto changed = entity_query.Changed<Position>(last_tick_).entities();
+            counts_.emplace_back(added.size(), changed.size());
+
+            // Added components are changed as well.
+            for (auto entity : added) { ASSERT_TRUE(std::binary_search(changed.cbegin(), changed.cend(), entity)); }
+
+            switch (access.GetTick())
+            {
+                case 1:
+                    access.Write<Position>(entities_[0]).x = 1.f;
+                    break;
+                case 2:
+                    access.Commands().AddComponent<Position>(access.Commands().CreateEntity(), Position{});
+                    access.Commands().AddComponent<Position>(entities_[3], Position{3.f});
+                    break;
+                default:
+                    break;
+            }
+
+            last_tick_ = access.GetTick();
+        }
+
+        EntityRange                              entities_;
+        std::vector<std::pair<size_t, size_t>>& counts_;
+        Tick                                     last_tick_ = 0;
+    };
+
+    std::vector<std::pair<size_t, size_t>> counts;
+    ASSERT_NO_THROW(world.RegisterSystem<TrackingSystem>(entities, counts));
+
+    // Everything is added at tick 0.
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(counts.back(), std::make_pair(size_t(10), size_t(10)));
+
+    // Changes made between steps are stamped with the tick of the previous step.
+    ASSERT_NO_THROW(world.MarkChanged<Position>(entities[5]));
+    ASSERT_THROW(world.MarkChanged<Velocity>(entities[5]), std::runtime_error);
+    world.AddComponent<Velocity>(entities[6]);
+
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(world.GetTick(), 2u);
+    ASSERT_EQ(counts.back(), std::make_pair(size_t(0), size_t(2)));
+
+    // Commands are applied at the end of the step, overwritten component is changed, not added.
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(counts.back(), std::make_pair(size_t(1), size_t(2)));
+
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(counts.back(), std::make_pair(size_t(0), size_t(0)));
+}
+
+TEST_F(Test, CachedQuery)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    struct Frozen
+    {
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<Frozen>());
+
+    auto moving = world.CreateEntities(10, Position{}, Velocity{});
+    auto still  = world.CreateEntities(5, Position{});
+
+    // Existing entities are matched on registration, same signature yields the same query.
+    auto& query = world.RegisterQuery<Position, Velocity>();
+    ASSERT_EQ(query.size(), 10u);
+    auto& same = world.RegisterQuery<Velocity, const Position>();
+    ASSERT_EQ(&query, &same);
+    ASSERT_THROW((world.RegisterQuery<Position, std::string>()), std::runtime_error);
+
+    struct CheckSystem : public System
+    {
+        explicit CheckSystem(std::vector<size_t>& sizes) : sizes_(sizes) {}
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& query    = entity_query.Cached<Position, Velocity>();
+            auto  expected = entity_query.WithComponents<Position, Velocity>().entities();
+
+            EntitySet::EntityStorage entities(query.begin(), query.end());
+            std::sort(entities.begin(), entities.end());
+            ASSERT_EQ(entities, expected);
+
+            for (auto entity : expected) { ASSERT_TRUE(query.Contains(entity)); }
+
+            auto& frozen = entity_query.Cached<Position, Frozen>();
+            auto  count  = entity_query.WithComponents<Position, Frozen>().entities().size();
+            ASSERT_EQ(frozen.size(), count);
+
+            sizes_.push_back(query.size());
+
+            if (!clones_.empty())
+            {
+                access.Commands().DestroyEntity(clones_[0]);
+                access.Commands().RemoveComponent<Velocity>(clones_[1]);
+                access.Commands().AddComponent<Velocity>(still_, Velocity{});
+                clones_ = EntityRange();
+            }
+        }
+
+        std::vector<size_t>& sizes_;
+        EntityRange          clones_;
+        Entity               still_ = kInvalidEntity;
+    };
+
+    std::vector<size_t> sizes;
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>(sizes));
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(sizes.back(), 10u);
+
+    // Adding and removing components moves entities in and out.
+    world.AddComponent<Velocity>(still[0]);
+    world.RemoveComponent<Position>(moving[0]);
+    world.AddComponent<Frozen>(moving[1]);
+    ASSERT_TRUE(query.Contains(still[0]));
+    ASSERT_FALSE(query.Contains(moving[0]));
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(sizes.back(), 10u);
+
+    // Destroyed entities leave, stale handles do not match slots reused by new entities.
+    world.DestroyEntity(moving[2]);
+    world.DestroyEntities({moving[3], moving[4], still[1]});
+    auto reused = world.CreateEntity().AddComponent<Position>().AddComponent<Velocity>().Build();
+    ASSERT_FALSE(query.Contains(moving[2]));
+    ASSERT_FALSE(query.Contains(still[1]));
+    ASSERT_TRUE(query.Contains(reused));
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(sizes.back(), 8u);
+
+    // Batches and command buffers are tracked as well.
+    world.GetSystem<CheckSystem>().clones_ = world.CreateEntities(20, moving[5]);
+    world.GetSystem<CheckSystem>().still_  = still[2];
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(sizes.back(), 8u + 20u);
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(sizes.back(), 8u + 20u - 2u + 1u);
+
+    world.Reset();
+}
+
+TEST_F(Test, QueryTerms)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 1.f;
+    };
+
+    struct Mass
+    {
+        float m = 2.f;
+    };
+
+    struct Frozen
+    {
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+    ASSERT_NO_THROW(world.RegisterComponent<Mass>());
+    ASSERT_NO_THROW(world.RegisterComponent<Frozen>());
+
+    constexpr size_t kNumEntities = 300;
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>();
+        if (i % 2 == 0)
+        {
+            builder.AddComponent<Velocity>();
+        }
+        if (i % 3 == 0)
+        {
+            builder.AddComponent<Frozen>();
+        }
+        if (i % 5 == 0)
+        {
+            builder.AddComponent<Mass>();
+        }
+    }
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& velocities = access.Read<Velocity>();
+            auto& frozen     = access.Read<Frozen>();
+            auto& masses     = access.Read<Mass>();
+
+            auto expected = entity_query().Filter([&velocities, &frozen](Entity e) {
+                return velocities.HasComponent(e) && !frozen.HasComponent(e);
+            });
+
+            auto matched = entity_query.Match<With<Position, Velocity>, Without<Frozen>>().entities();
+            ASSERT_EQ(matched, expected.entities());
+            ASSERT_EQ(entity_query.Match<Without<Frozen>>().entities().size(), kNumEntities * 2 / 3);
+            auto frozen_light = entity_query.Match<With<Frozen>, Without<Mass>>().entities();
+            ASSERT_EQ(frozen_light.size(), kNumEntities / 3 - kNumEntities / 15);
+            ASSERT_THROW(entity_query.Match<Without<std::string>>(), std::runtime_error);
+
+            size_t num_visited = 0;
+            size_t num_massive = 0;
+            entity_query.ForEach<With<Position, const Velocity>, Without<Frozen>, Optional<const Mass>>(
+                [&](Entity e, Position& position, const Velocity& velocity, const Mass* mass) {
+                    position.x += velocity.x;
+                    ASSERT_EQ(mass != nullptr, masses.HasComponent(e));
+                    num_massive += mass ? 1 : 0;
+                    ++num_visited;
+                });
+
+            ASSERT_EQ(num_visited, matched.size());
+            ASSERT_EQ(num_massive, kNumEntities / 15);
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+
+    world.Reset();
+}
+
+TEST_F(Test, EntityPipeline)
+{
+    using namespace yecs;
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+
+    constexpr size_t kNumEntities = 10000;
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>(Position{static_cast<float>(i)});
+        if (i % 2 == 0)
+        {
+            builder.AddComponent<Velocity>();
+        }
+    }
+
+    struct CheckSystem : public System
+    {
+        explicit CheckSystem(std::atomic<size_t>& num_processed) : num_processed_(num_processed) {}
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& positions  = access.Read<Position>();
+            auto& velocities = access.Read<Velocity>();
+
+            auto has_velocity = [&velocities](Entity e) { return velocities.HasComponent(e); };
+            auto x            = [&positions](Entity e) { return positions.GetComponent(e).x; };
+
+            auto all      = entity_query();
+            auto pipeline = all.Lazy().Filter(has_velocity).Transform(x).Filter([](float x) { return x >= 100.f; });
+
+            // Range-for, ForEach and Collect run the same single pass.
+            std::vector<float> iterated;
+            for (auto value : pipeline) { iterated.push_back(value); }
+
+            std::vector<float> visited;
+            pipeline.ForEach([&visited](float value) { visited.push_back(value); });
+
+            auto collected = pipeline.Collect();
+            ASSERT_EQ(iterated, visited);
+            ASSERT_EQ(iterated, collected);
+            ASSERT_EQ(iterated.size(), kNumEntities / 2 - 50);
+
+            // Pipelines producing entities collect into EntitySet, take stops the pipeline.
+            auto moving   = entity_query().Lazy().Filter(has_velocity).Collect();
+            auto expected = entity_query().Filter(has_velocity);
+            ASSERT_EQ(moving.entities().size(), expected.entities().size());
+
+            auto first = entity_query().Lazy().Filter(has_velocity).Take(3).Collect().entities();
+            ASSERT_EQ(first, EntitySet::EntityStorage(moving.entities().begin(), moving.entities().begin() + 3));
+
+            size_t num_taken = 0;
+            for (auto e : all.Lazy().Take(5).Filter(has_velocity)) { num_taken += has_velocity(e) ? 1 : 0; }
+            ASSERT_EQ(num_taken, 3u);
+            ASSERT_TRUE(all.Lazy().Take(0).begin() == all.Lazy().Take(0).end());
+
+            // Cached queries are sources too, pipelines without take run in parallel.
+            auto& query = entity_query.Cached<Position, Velocity>();
+            ASSERT_EQ(query.Lazy().Filter([&x](Entity e) { return x(e) < 100.f; }).Collect().entities().size(), 50u);
+
+            ParallelForEach(
+                subflow,
+                query.Lazy().Transform(x),
+                [counter = &num_processed_](float) { ++*counter; },
+                64);
+        }
+
+        std::atomic<size_t>& num_processed_;
+    };
+
+    std::atomic<size_t> num_processed{0};
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>(num_processed));
+    ASSERT_NO_THROW(world.Run());
+    ASSERT_EQ(num_processed, kNumEntities / 2);
+
+    world.Reset();
+}
+
+TEST_F(Test, EntitySetOperations)
+{
+    using namespace yecs;
+
+    // Kernels against std:: algorithms, sizes cover vector blocks and scalar tails.
+    std::mt19937 rng(7);
+    for (auto size : {0u, 3u, 4u, 17u, 100u, 1000u})
+    {
+        for (auto density : {2u, 5u, 50u})
+        {
+            std::vector<Entity> a, b;
+            for (auto i = 0u; i < size * density; ++i)
+            {
+                if (rng() % density == 0)
+                {
+                    a.push_back(i);
+                }
+                if (rng() % density == 0)
+                {
+                    b.push_back(i);
+                }
+            }
+
+            std::vector<Entity> expected, result(a.size() + b.size());
+
+            std::set_intersection(a.cbegin(), a.cend(), b.cbegin(), b.cend(), std::back_inserter(expected));
+            result.resize(detail::IntersectSorted(a.data(), a.size(), b.data(), b.size(), result.data()));
+            ASSERT_EQ(result, expected);
+
+            expected.clear();
+            result.resize(a.size() + b.size());
+            std::set_difference(a.cbegin(), a.cend(), b.cbegin(), b.cend(), std::back_inserter(expected));
+            result.resize(detail::SubtractSorted(a.data(), a.size(), b.data(), b.size(), result.data()));
+            ASSERT_EQ(result, expected);
+        }
+    }
+
+    World world;
+
+    struct Position
+    {
+        float x = 0.f;
+    };
+
+    struct Velocity
+    {
+        float x = 0.f;
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Position>());
+    ASSERT_NO_THROW(world.RegisterComponent<Velocity>());
+
+    constexpr size_t kNumEntities = 1000;
+
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        if (i % 2 == 0)
+        {
+            builder.AddComponent<Position>();
+        }
+        if (i % 3 == 0)
+        {
+            builder.AddComponent<Velocity>();
+        }
+    }
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            auto& positions = access.Read<Position>();
+
+            auto with_position = entity_query.WithComponents<Position>();
+            auto with_velocity = entity_query.WithComponents<Velocity>();
+            auto with_both     = entity_query.WithComponents<Position, Velocity>();
+
+            // Query results are sorted and stay sorted after filtering.
+            auto is_odd   = [](Entity e) { return GetEntityIndex(e) % 5 == 1; };
+            auto filtered = entity_query().Filter(is_odd).Filter([&positions](Entity e) {
+                return positions.HasComponent(e);
+            });
+            ASSERT_TRUE(filtered.sorted());
+            ASSERT_TRUE(std::is_sorted(filtered.entities().cbegin(), filtered.entities().cend()));
+            ASSERT_TRUE(with_position.Lazy().Filter(is_odd).Collect().sorted());
+
+            ASSERT_EQ(with_position.Intersection(with_velocity).entities(), with_both.entities());
+            auto only_position = with_position.Difference(with_velocity).entities();
+            ASSERT_EQ(only_position.size(), kNumEntities / 2 - kNumEntities / 6 - 1);
+            ASSERT_EQ(with_position.Union(with_velocity).entities().size(),
+                      with_position.entities().size() + with_velocity.entities().size() - with_both.entities().size());
+
+            // Unsorted sets are sorted for merging.
+            // Indices of velocities are multiples of 3, mirroring them yields the same entities in reverse.
+            auto reversed = with_velocity.Lazy()
+                                .Transform([](Entity e) {
+                                    return MakeEntity(kNumEntities - 1 - GetEntityIndex(e), GetEntityGeneration(e));
+                                })
+                                .Collect();
+            ASSERT_FALSE(reversed.sorted());
+            ASSERT_EQ(with_position.Intersection(reversed).entities(), with_both.entities());
+            ASSERT_TRUE(reversed.Sort().sorted());
+            ASSERT_EQ(reversed.entities(), with_velocity.entities());
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+}
+
+TEST_F(Test, CompressedEntitySet)
+{
+    using namespace yecs;
+    World world;
+
+    struct Sparse
+    {
+        float x = 0.f;
+    };
+
+    struct Dense
+    {
+        float x = 0.f;
+    };
+
+    struct Contiguous
+    {
+    };
+
+    ASSERT_NO_THROW(world.RegisterComponent<Sparse>());
+    ASSERT_NO_THROW(world.RegisterComponent<Dense>());
+    ASSERT_NO_THROW(world.RegisterComponent<Contiguous>());
+
+    // Three blocks and a half, every pattern crosses block boundaries.
+    constexpr size_t kNumEntities = CompressedEntitySet::kBlockSize * 7 / 2;
+
+    std::mt19937 rng(11);
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        if (rng() % 100 == 0)
+        {
+            builder.AddComponent<Sparse>();
+        }
+        if (rng() % 3 != 0)
+        {
+            builder.AddComponent<Dense>();
+        }
+        if (i > kNumEntities / 5 && i < kNumEntities / 2)
+        {
+            builder.AddComponent<Contiguous>();
+        }
+    }
+
+    struct CheckSystem : public System
+    {
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            using ContainerType = CompressedEntitySet::ContainerType;
+
+            auto sparse     = entity_query.MatchCompressed<With<Sparse>>();
+            auto dense      = entity_query.MatchCompressed<With<Dense>>();
+            auto contiguous = entity_query.MatchCompressed<With<Contiguous>>();
+
+            // Container kinds follow density.
+            ASSERT_EQ(sparse.container_type(0), ContainerType::kArray);
+            ASSERT_EQ(dense.container_type(0), ContainerType::kBitmap);
+            ASSERT_EQ(contiguous.container_type(0), ContainerType::kRun);
+            ASSERT_LT(dense.memory_usage(), dense.size() * sizeof(Entity) / 4);
+            ASSERT_LT(contiguous.memory_usage(), 1024u);
+
+            // Iteration, lookup and decompression agree with plain sets.
+            auto check = [](const CompressedEntitySet& compressed, const EntitySet& expected) {
+                ASSERT_EQ(compressed.size(), expected.entities().size());
+                ASSERT_EQ(compressed.Decompress().entities(), expected.entities());
+                ASSERT_TRUE(std::equal(compressed.begin(), compressed.end(), expected.entities().cbegin()));
+
+                size_t i = 0;
+                compressed.ForEach([&expected, &i](Entity e) { ASSERT_EQ(e, expected.entities()[i++]); });
+                for (auto e : expected.entities()) { ASSERT_TRUE(compressed.Contains(e)); }
+            };
+
+            auto plain_sparse     = entity_query.Match<With<Sparse>>();
+            auto plain_dense      = entity_query.Match<With<Dense>>();
+            auto plain_contiguous = entity_query.Match<With<Contiguous>>();
+
+            check(sparse, plain_sparse);
+            check(dense, plain_dense);
+            check(contiguous, plain_contiguous);
+            ASSERT_FALSE(contiguous.Contains(MakeEntity(0, 0)));
+            // Last block is populated but ends past the generation table.
+            ASSERT_FALSE(dense.Contains(MakeEntity(CompressedEntitySet::kBlockSize * 4 - 1, 0)));
+
+            // Set operations over every pair of container kinds.
+            check(sparse.Intersection(dense), plain_sparse.Intersection(plain_dense));
+            check(dense.Intersection(contiguous), plain_dense.Intersection(plain_contiguous));
+            check(sparse.Union(contiguous), plain_sparse.Union(plain_contiguous));
+            check(dense.Union(sparse), plain_dense.Union(plain_sparse));
+            check(dense.Difference(contiguous), plain_dense.Difference(plain_contiguous));
+            check(contiguous.Difference(sparse), plain_contiguous.Difference(plain_sparse));
+            check(sparse.Difference(sparse), entity_query.Match<With<Sparse>, Without<Sparse>>());
+        }
+    };
+
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>());
+    ASSERT_NO_THROW(world.Run());
+}
+
+TEST_F(Test, FrameArenaAlignment)
+{
+    using namespace yecs;
+
+    // Aligning the second allocation steps past the end of the first block.
+    FrameArena arena(100);
+    auto       first  = static_cast<std::byte*>(arena.allocate(98, 2));
+    auto       second = static_cast<std::byte*>(arena.allocate(8, 8));
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(second) % 8, 0u);
+    ASSERT_TRUE(second >= first + 98 || second + 8 <= first);
+    ASSERT_GT(arena.capacity(), 100u);
+
+    // Mixed sizes and alignments, every allocation is aligned, fits and does not overlap the others.
+    std::mt19937                               rng(42);
+    std::vector<std::pair<std::byte*, size_t>> allocations;
+    for (auto frame = 0; frame < 3; ++frame)
+    {
+        arena.Reset();
+        allocations.clear();
+
+        for (auto i = 0; i < 1000; ++i)
+        {
+            size_t alignment = size_t(1) << (rng() % 7);
+            size_t size      = rng() % 300 + 1;
+            auto   p         = static_cast<std::byte*>(arena.allocate(size, alignment));
+
+            ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignment, 0u);
+            std::fill(p, p + size, std::byte(i & 0xff));
+            allocations.emplace_back(p, size);
+        }
+
+        for (auto i = 0u; i < allocations.size(); ++i)
+        {
+            auto [p, size] = allocations[i];
+            ASSERT_TRUE(std::all_of(p, p + size, [i](std::byte b) { return b == std::byte(i & 0xff); }));
+        }
+    }
+}
+
+TEST_F(Test, FrameArena)
+{
+    using namespace yecs;
+
+    // A single worker, so the system always gets the same arena.
+    WorldConfig config;
+    config.num_threads = 1;
+    World world(config);
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    struct Velocity
+    {
+        float x, y, z;
+    };
+
+    struct Frozen
+    {
+    };
+
+    world.RegisterComponent<Position>();
+    world.RegisterComponent<Velocity>();
+    world.RegisterComponent<Frozen>();
+
+    static constexpr size_t kNumEntities = 10000;
+    for (auto i = 0u; i < kNumEntities; ++i)
+    {
+        auto builder = world.CreateEntity();
+        builder.AddComponent<Position>();
+        if (i % 2 == 0)
+        {
+            builder.AddComponent<Velocity>();
+        }
+        if (i % 3 == 0)
+        {
+            builder.AddComponent<Frozen>();
+        }
+        builder.Build();
+    }
+
+    struct CheckSystem : public System
+    {
+        explicit CheckSystem(std::vector<size_t>& allocations) : allocations_(allocations) {}
+
+        void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+        {
+            // Previous frame has been released.
+            ASSERT_EQ(access.FrameArena().used(), 0u);
+
+            auto before = g_num_allocations;
+
+            auto frame_query = entity_query.Using(&access.FrameArena());
+            auto all         = frame_query();
+            auto moving      = frame_query.WithComponents<Position, Velocity>();
+            auto active      = frame_query.Match<With<Position>, Without<Frozen>>();
+            auto changed     = frame_query.Changed<Position>(0);
+            auto even    = all.Filter([](Entity e) { return GetEntityIndex(e) % 2 == 0; });
+            auto both    = moving.Intersection(active).Union(even).Difference(changed);
+            auto first   = std::move(active).Lazy().Filter([](Entity e) { return GetEntityIndex(e) % 5 == 0; }).Collect();
+
+            std::pmr::vector<float> scratch(kNumEntities, 0.f, &access.FrameArena());
+            frame_query.ForEach<With<Position, const Velocity>, Without<Frozen>>(
+                [&scratch](Entity e, Position& pos, const Velocity& vel) { scratch[GetEntityIndex(e)] = pos.x + vel.x; });
+
+            allocations_.push_back(g_num_allocations - before);
+
+            ASSERT_EQ(all.entities().size(), kNumEntities);
+            ASSERT_EQ(moving.entities().size(), kNumEntities / 2);
+            ASSERT_EQ(changed.entities().size(), kNumEntities);
+            ASSERT_TRUE(both.entities().empty());
+            ASSERT_EQ(first.entities().size(), 1333u);
+        }
+
+        std::vector<size_t>& allocations_;
+    };
+
+    std::vector<size_t> allocations;
+    allocations.reserve(4);
+    ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>(allocations));
+
+    for (auto i = 0; i < 4; ++i) { ASSERT_NO_THROW(world.Run()); }
+
+    // Arena grows during the first frame, after that frames do not touch the heap.
+    ASSERT_EQ(allocations.size(), 4u);
+    ASSERT_GT(allocations[0], 0u);
+    ASSERT_EQ(allocations[1], 0u);
+    ASSERT_EQ(allocations[2], 0u);
+    ASSERT_EQ(allocations[3], 0u);
+}
+
+TEST_F(Test, MemoryResource)
+{
+    using namespace yecs;
+
+    // Counts bytes going through the resource.
+    struct CountingResource : public std::pmr::memory_resource
+    {
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            allocated += bytes;
+            live += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override
+        {
+            live -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& rhs) const noexcept override { return this == &rhs; }
+
+        size_t allocated = 0;
+        size_t live      = 0;
+    };
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    struct Velocity
+    {
+        float x, y, z;
+    };
+
+    struct Frozen
+    {
+    };
+
+    CountingResource world_resource;
+    CountingResource velocity_resource;
+
+    {
+        WorldConfig config;
+        config.memory_resource = &world_resource;
+        World world(config);
+        ASSERT_EQ(world.GetMemoryResource(), &world_resource);
+
+        world.RegisterComponent<Position>();
+        world.RegisterComponent<Velocity>(&velocity_resource);
+        world.RegisterComponent<Frozen>();
+
+        constexpr size_t kNumEntities = 1000;
+        std::vector<Entity> entities;
+        entities.reserve(kNumEntities);
+        for (auto i = 0u; i < kNumEntities; ++i) { entities.push_back(world.CreateEntity().Build()); }
+
+        // Components and entity tables do not touch the global heap.
+        auto before = g_num_allocations;
+        for (auto e : entities)
+        {
+            world.AddComponent<Position>(e);
+            world.AddComponent<Velocity>(e);
+            if (GetEntityIndex(e) % 2 == 0)
+            {
+                world.AddComponent<Frozen>(e);
+            }
+        }
+        ASSERT_EQ(g_num_allocations, before);
+
+        ASSERT_GE(world_resource.live, kNumEntities * sizeof(Position));
+        ASSERT_GE(velocity_resource.live, kNumEntities * sizeof(Velocity));
+        ASSERT_LT(velocity_resource.live, world_resource.live);
+
+        struct CheckSystem : public System
+        {
+            explicit CheckSystem(std::pmr::memory_resource* resource) : resource_(resource) {}
+
+            void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) override
+            {
+                // Query results come from the world resource unless bound to the frame arena.
+                auto moving = entity_query.Match<With<Position, Velocity>, Without<Frozen>>();
+                ASSERT_EQ(moving.entities().size(), 500u);
+                ASSERT_EQ(moving.entities().get_allocator().resource(), resource_);
+                auto frame_query  = entity_query.Using(&access.FrameArena());
+                auto frame_moving = frame_query.Match<With<Position, Velocity>, Without<Frozen>>();
+                ASSERT_EQ(frame_moving.entities().size(), 500u);
+                ASSERT_EQ(frame_moving.entities().get_allocator().resource(), &access.FrameArena());
+                ASSERT_EQ((entity_query.Cached<Position, Velocity>().size()), 1000u);
+            }
+
+            std::pmr::memory_resource* resource_;
+        };
+
+        // Frame arenas and cached queries allocate from the world resource too.
+        auto allocated = world_resource.allocated;
+        ASSERT_NO_THROW(world.RegisterSystem<CheckSystem>(&world_resource));
+        ASSERT_NO_THROW(world.Run());
+        ASSERT_GE(world_resource.allocated, allocated + FrameArena::kDefaultBlockSize);
+    }
+
+    // Everything has been returned.
+    ASSERT_EQ(world_resource.live, 0u);
+    ASSERT_EQ(velocity_resource.live, 0u);
+
+    // Bulk removal scratch comes from the storage resource too.
+    CountingResource paged_resource;
+    {
+        PagedComponentStorage<Position, 64> storage(&paged_resource);
+        std::vector<Entity>                 removed;
+        for (auto i = 0u; i < 256u; ++i) { storage.AddComponent(MakeEntity(i, 0)); }
+        for (auto i = 0u; i < 256u; i += 2) { removed.push_back(MakeEntity(i, 0)); }
+
+        auto before = g_num_allocations;
+        storage.RemoveComponents(removed.data(), removed.size());
+        ASSERT_EQ(g_num_allocations, before);
+        ASSERT_EQ(storage.size(), 128u);
+    }
+    ASSERT_EQ(paged_resource.live, 0u);
+}
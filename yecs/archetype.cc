@@ -0,0 +1,280 @@
+#include "archetype.h"
+
+namespace yecs
+{
+namespace
+{
+// Align offset up to a given alignment.
+size_t AlignUp(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+Archetype::Archetype(ArchetypeSignature             signature,
+                     const std::vector<ColumnType>& types,
+                     std::pmr::memory_resource*     resource)
+    : signature_(signature), types_(types), column_offsets_(types.size(), 0), resource_(resource), chunks_(resource)
+{
+    size_t row_size = sizeof(Entity);
+
+    for (auto bits = signature_; bits; bits &= bits - 1)
+    {
+        auto& type = types_[CountTrailingZeros(bits)];
+
+        if (type.alignment > kChunkAlignment)
+        {
+            throw std::runtime_error("Archetype: component alignment is too large");
+        }
+
+        row_size += type.size;
+    }
+
+    // Lay out the columns: entity column goes first, then components in bit order.
+    auto layout = [this](size_t capacity) {
+        size_t offset = capacity * sizeof(Entity);
+        for (auto bits = signature_; bits; bits &= bits - 1)
+        {
+            auto  bit            = CountTrailingZeros(bits);
+            auto& type           = types_[bit];
+            offset               = AlignUp(offset, type.alignment);
+            column_offsets_[bit] = offset;
+            offset += capacity * type.size;
+        }
+        return offset;
+    };
+
+    // Fit as many rows as possible into a chunk, but at least one.
+    chunk_capacity_ = std::max<size_t>(kChunkSize / row_size, 1);
+
+    while (chunk_capacity_ > 1 && layout(chunk_capacity_) > kChunkSize)
+    {
+        --chunk_capacity_;
+    }
+
+    chunk_bytes_ = AlignUp(std::max(kChunkSize, layout(chunk_capacity_)), kChunkAlignment);
+}
+
+Archetype::~Archetype()
+{
+    for (size_t row = 0; row < size_; ++row)
+    {
+        for (auto bits = signature_; bits; bits &= bits - 1)
+        {
+            auto bit = CountTrailingZeros(bits);
+            types_[bit].destroy(component(row, bit));
+        }
+    }
+
+    for (auto chunk : chunks_) { resource_->deallocate(chunk, chunk_bytes_, kChunkAlignment); }
+}
+
+size_t Archetype::Allocate(Entity entity)
+{
+    if (size_ == chunks_.size() * chunk_capacity_)
+    {
+        // Grow the chunk list before allocating a chunk, so a throwing push_back can not leak it.
+        if (chunks_.size() == chunks_.capacity())
+        {
+            chunks_.reserve(std::max<size_t>(2 * chunks_.capacity(), 4));
+        }
+        chunks_.push_back(static_cast<std::byte*>(resource_->allocate(chunk_bytes_, kChunkAlignment)));
+    }
+
+    auto row = size_++;
+    entities(row / chunk_capacity_)[row % chunk_capacity_] = entity;
+    return row;
+}
+
+void Archetype::Abandon()
+{
+    --size_;
+}
+
+Entity Archetype::Free(size_t row)
+{
+    auto last  = size_ - 1;
+    auto moved = kInvalidEntity;
+
+    for (auto bits = signature_; bits; bits &= bits - 1)
+    {
+        auto bit = CountTrailingZeros(bits);
+        types_[bit].destroy(component(row, bit));
+
+        if (row != last)
+        {
+            types_[bit].move_construct(component(row, bit), component(last, bit));
+            types_[bit].destroy(component(last, bit));
+        }
+    }
+
+    if (row != last)
+    {
+        moved                                                  = entity(last);
+        entities(row / chunk_capacity_)[row % chunk_capacity_] = moved;
+    }
+
+    --size_;
+
+    // Release the last chunk once the one before it is empty too, keeping a single spare chunk.
+    if (chunks_.size() > 1 && size_ <= (chunks_.size() - 2) * chunk_capacity_)
+    {
+        resource_->deallocate(chunks_.back(), chunk_bytes_, kChunkAlignment);
+        chunks_.pop_back();
+    }
+
+    return moved;
+}
+
+bool ArchetypeTable::HasComponent(Entity entity, size_t bit) const noexcept
+{
+    auto index = GetEntityIndex(entity);
+    return index < locations_.size() && locations_[index].archetype &&
+           locations_[index].archetype->HasComponent(bit);
+}
+
+void* ArchetypeTable::FindComponent(Entity entity, size_t bit) const noexcept
+{
+    if (!HasComponent(entity, bit))
+    {
+        return nullptr;
+    }
+
+    auto& location = locations_[GetEntityIndex(entity)];
+    return location.archetype->component(location.row, bit);
+}
+
+void ArchetypeTable::RemoveComponent(Entity entity, size_t bit)
+{
+    if (!HasComponent(entity, bit))
+    {
+        throw std::runtime_error("ArchetypeTable: Entity does not have a component");
+    }
+
+    auto& location  = locations_[GetEntityIndex(entity)];
+    auto  signature = location.archetype->signature() & ~(ArchetypeSignature(1) << bit);
+
+    // The last component is removed, entity leaves the table.
+    if (!signature)
+    {
+        DestroyEntity(entity);
+        return;
+    }
+
+    auto& dst = GetArchetype(signature);
+    Move(entity, dst, dst.Allocate(entity));
+    --counts_[bit];
+}
+
+void ArchetypeTable::DestroyEntity(Entity entity)
+{
+    auto index = GetEntityIndex(entity);
+
+    if (index >= locations_.size() || !locations_[index].archetype)
+    {
+        return;
+    }
+
+    auto& location = locations_[index];
+
+    for (auto bits = location.archetype->signature(); bits; bits &= bits - 1) { --counts_[CountTrailingZeros(bits)]; }
+
+    auto moved = location.archetype->Free(location.row);
+
+    if (moved != kInvalidEntity)
+    {
+        locations_[GetEntityIndex(moved)].row = location.row;
+    }
+
+    location = EntityLocation();
+}
+
+void ArchetypeTable::CloneEntity(Entity source, const EntityRange& entities)
+{
+    auto index = GetEntityIndex(source);
+
+    if (index >= locations_.size() || !locations_[index].archetype)
+    {
+        return;
+    }
+
+    auto& src       = *locations_[index].archetype;
+    auto  signature = src.signature();
+
+    for (auto bits = signature; bits; bits &= bits - 1)
+    {
+        if (!types_[CountTrailingZeros(bits)].copy_construct)
+        {
+            throw std::runtime_error("ArchetypeTable: component is not copy constructible");
+        }
+    }
+
+    // Source row stays in place while rows are appended, chunks are never relocated.
+    auto row = locations_[index].row;
+    AddEntities(entities, signature, [this, &src, row](size_t bit, void* ptr) {
+        types_[bit].copy_construct(ptr, src.component(row, bit));
+    });
+}
+
+Archetype& ArchetypeTable::GetArchetype(ArchetypeSignature signature)
+{
+    auto archetype = archetype_index_.find(signature);
+
+    if (archetype != archetype_index_.cend())
+    {
+        return *archetype->second;
+    }
+
+    archetypes_.push_back(std::make_unique<Archetype>(signature, types_, resource_));
+    archetype_index_.emplace(signature, archetypes_.back().get());
+    return *archetypes_.back();
+}
+
+void ArchetypeTable::Reset()
+{
+    locations_.clear();
+    archetype_index_.clear();
+    archetypes_.clear();
+    counts_.clear();
+    types_.clear();
+    bits_.clear();
+}
+
+ArchetypeTable::EntityLocation& ArchetypeTable::GetLocation(Entity entity)
+{
+    auto index = GetEntityIndex(entity);
+
+    if (index >= locations_.size())
+    {
+        locations_.resize(index + 1);
+    }
+
+    return locations_[index];
+}
+
+void ArchetypeTable::Move(Entity entity, Archetype& dst, size_t dst_row)
+{
+    auto& location = locations_[GetEntityIndex(entity)];
+
+    if (location.archetype)
+    {
+        auto& src = *location.archetype;
+
+        for (auto bits = src.signature() & dst.signature(); bits; bits &= bits - 1)
+        {
+            auto bit = CountTrailingZeros(bits);
+            types_[bit].move_construct(dst.component(dst_row, bit), src.component(location.row, bit));
+        }
+
+        auto moved = src.Free(location.row);
+
+        if (moved != kInvalidEntity)
+        {
+            locations_[GetEntityIndex(moved)].row = location.row;
+        }
+    }
+
+    location.archetype = &dst;
+    location.row       = dst_row;
+}
+}  // namespace yecs
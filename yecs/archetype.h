@@ -0,0 +1,648 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+
+namespace yecs
+{
+// Set of component bits of an archetype.
+using ArchetypeSignature = uint64_t;
+
+// Maximum number of component types stored in archetypes.
+constexpr size_t kMaxArchetypeComponents = 64;
+
+/**
+ * @brief Type-erased operations on a component type stored in archetype chunks.
+ **/
+struct ColumnType
+{
+    size_t size      = 0;
+    size_t alignment = 0;
+    // Move-construct an object at dst from src, src is left in moved-from state.
+    void (*move_construct)(void* dst, void* src) = nullptr;
+    // Copy-construct an object at dst from src, nullptr if the type is not copy constructible.
+    void (*copy_construct)(void* dst, const void* src) = nullptr;
+    // Destroy an object.
+    void (*destroy)(void* ptr) = nullptr;
+
+    template <typename T>
+    static ColumnType Create();
+};
+
+/**
+ * @brief A table of entities sharing the same set of components.
+ *
+ * Entities are stored in fixed size chunks (kChunkSize bytes by default), each chunk holds an entity
+ * column followed by one column per component type. Rows are kept packed: all the chunks except the last
+ * one are full, removal moves the last row into the vacated one. One empty chunk is kept as a spare when
+ * the last chunk drains, so entities oscillating around a chunk boundary do not reallocate it every time.
+ **/
+class Archetype
+{
+public:
+    // Chunk size in bytes.
+    static constexpr size_t kChunkSize = 16 * 1024;
+    // Chunk alignment in bytes.
+    static constexpr size_t kChunkAlignment = 64;
+
+    /**
+     * @brief Create an archetype.
+     *
+     * @param signature Component bits of an archetype.
+     * @param types Column types of all registered components indexed by component bit.
+     * @param resource Memory resource chunks are allocated from.
+     **/
+    Archetype(ArchetypeSignature             signature,
+              const std::vector<ColumnType>& types,
+              std::pmr::memory_resource*     resource = std::pmr::get_default_resource());
+    ~Archetype();
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    // Component bits of an archetype.
+    ArchetypeSignature signature() const noexcept { return signature_; }
+    // True if archetype has a component with a given bit.
+    bool HasComponent(size_t bit) const noexcept { return (signature_ >> bit) & 1u; }
+
+    // Number of entities in the archetype.
+    size_t size() const noexcept { return size_; }
+    // Maximum number of entities in a chunk.
+    size_t chunk_capacity() const noexcept { return chunk_capacity_; }
+    // Number of chunks holding entities (the spare chunk is not counted).
+    size_t num_chunks() const noexcept { return (size_ + chunk_capacity_ - 1) / chunk_capacity_; }
+    // Number of entities in a chunk.
+    size_t chunk_size(size_t chunk) const noexcept;
+
+    // Entity column of a chunk.
+    Entity*       entities(size_t chunk) noexcept { return reinterpret_cast<Entity*>(chunks_[chunk]); }
+    const Entity* entities(size_t chunk) const noexcept { return reinterpret_cast<const Entity*>(chunks_[chunk]); }
+    // Component column of a chunk, archetype should have the component.
+    std::byte*       column(size_t chunk, size_t bit) noexcept { return chunks_[chunk] + column_offsets_[bit]; }
+    const std::byte* column(size_t chunk, size_t bit) const noexcept { return chunks_[chunk] + column_offsets_[bit]; }
+
+    // Entity at a row.
+    Entity entity(size_t row) const noexcept { return entities(row / chunk_capacity_)[row % chunk_capacity_]; }
+    // Component at a row, archetype should have the component.
+    std::byte*       component(size_t row, size_t bit) noexcept;
+    const std::byte* component(size_t row, size_t bit) const noexcept;
+
+    // Allocate a row for an entity, components are left uninitialized.
+    size_t Allocate(Entity entity);
+    // Release the last allocated row without destroying its components.
+    void Abandon();
+    // Destroy components at a row and move the last row into it.
+    // Returns an entity moved into the row or kInvalidEntity if row was the last one.
+    Entity Free(size_t row);
+
+private:
+    // Component bits.
+    ArchetypeSignature signature_;
+    // Column types indexed by component bit.
+    std::vector<ColumnType> types_;
+    // Column offsets within a chunk indexed by component bit.
+    std::vector<size_t> column_offsets_;
+    // Chunk size in bytes (larger than kChunkSize for huge components).
+    size_t chunk_bytes_ = kChunkSize;
+    // Number of rows in a chunk.
+    size_t chunk_capacity_ = 0;
+    // Number of rows.
+    size_t size_ = 0;
+    // Chunk memory.
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<std::byte*> chunks_;
+};
+
+/**
+ * @brief Archetype storage engine.
+ *
+ * Components registered in the table are stored in archetypes: entities with the same set of components
+ * live in the same archetype, adding or removing a component migrates an entity to another archetype.
+ * Iteration over entities having a set of components walks matching archetypes chunk by chunk.
+ **/
+class ArchetypeTable
+{
+public:
+    // Archetypes allocate their chunks from resource.
+    explicit ArchetypeTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : resource_(resource), locations_(resource)
+    {
+    }
+    ~ArchetypeTable() = default;
+
+    ArchetypeTable(const ArchetypeTable&) = delete;
+    ArchetypeTable& operator=(const ArchetypeTable&) = delete;
+
+    // Register component type and return its bit, throws std::runtime_error if there are too many components.
+    template <typename T>
+    size_t RegisterComponent();
+
+    // Get bit of a registered component type, throws std::runtime_error if type is not registered.
+    template <typename T>
+    size_t GetComponentBit() const;
+
+    // True if entity has a component.
+    bool HasComponent(Entity entity, size_t bit) const noexcept;
+
+    // Get component of an entity or nullptr if entity does not have it.
+    void* FindComponent(Entity entity, size_t bit) const noexcept;
+
+    /**
+     * @brief Add a component to an entity migrating it to another archetype.
+     *
+     * @param entity Entity to add a component to.
+     * @param bit Component bit.
+     * @param construct Function constructing a component at a given address.
+     *
+     * @return Pointer to a constructed component.
+     * @throw std::runtime_error if entity already has a component.
+     **/
+    template <typename F>
+    void* AddComponent(Entity entity, size_t bit, F&& construct);
+
+    // Remove component from an entity migrating it to another archetype.
+    // Throws std::runtime_error if entity does not have a component.
+    void RemoveComponent(Entity entity, size_t bit);
+
+    /**
+     * @brief Place a range of entities into an archetype at once.
+     *
+     * Entities should not have any components in the table yet, every entity is allocated a row in the
+     * archetype of signature directly instead of migrating once per component. If construction throws,
+     * entities placed so far keep their components.
+     *
+     * @param entities Entities to place.
+     * @param signature Components of the archetype.
+     * @param construct Function constructing a component with a given bit at a given address: construct(bit, ptr).
+     * @throw std::runtime_error if an entity already has components in the table.
+     **/
+    template <typename F>
+    void AddEntities(const EntityRange& entities, ArchetypeSignature signature, F&& construct);
+
+    // Copy all the components of source entity to a range of entities having no components in the table.
+    // Throws std::runtime_error if a component is not copy constructible.
+    void CloneEntity(Entity source, const EntityRange& entities);
+
+    // Remove all the components of an entity.
+    void DestroyEntity(Entity entity);
+
+    // Remove all the entities, archetypes and component registrations.
+    void Reset();
+
+    // Number of entities having a component.
+    size_t GetNumComponents(size_t bit) const noexcept { return counts_[bit]; }
+
+    // All the archetypes.
+    const std::vector<std::unique_ptr<Archetype>>& archetypes() const noexcept { return archetypes_; }
+
+    // Signature of a set of components.
+    template <typename... Ts>
+    ArchetypeSignature GetSignature() const
+    {
+        return ((ArchetypeSignature(1) << GetComponentBit<Ts>()) | ... | 0);
+    }
+
+private:
+    // Location of an entity in archetypes.
+    struct EntityLocation
+    {
+        Archetype* archetype = nullptr;
+        size_t     row       = 0;
+    };
+
+    // Find or create an archetype.
+    Archetype& GetArchetype(ArchetypeSignature signature);
+    // Get entity location, extending location array if needed.
+    EntityLocation& GetLocation(Entity entity);
+    // Move components shared by archetypes from current location to a row of dst archetype, update location.
+    void Move(Entity entity, Archetype& dst, size_t dst_row);
+
+    // Resource of archetype chunks and entity locations.
+    std::pmr::memory_resource* resource_;
+    // Component bits indexed by component type id, kInvalidComponentBit for types not in the table.
+    std::vector<size_t> bits_;
+    // Column types indexed by component bit.
+    std::vector<ColumnType> types_;
+    // Archetypes.
+    std::vector<std::unique_ptr<Archetype>>               archetypes_;
+    std::unordered_map<ArchetypeSignature, Archetype*> archetype_index_;
+    // Entity locations indexed by entity index.
+    std::pmr::vector<EntityLocation> locations_;
+    // Number of components of each type.
+    std::vector<size_t> counts_;
+};
+
+/**
+ * @brief Iterates entities having a set of components stored in archetypes.
+ *
+ * Matching archetypes are processed chunk by chunk, so component columns are accessed linearly.
+ * Const-qualified component types are accessed read-only. A view over const-qualified components only
+ * can be created from a const table, a view writing any component needs a mutable one.
+ **/
+template <typename... ComponentTs>
+class ArchetypeView
+{
+public:
+    // Table type, const unless some of the components are written.
+    using TableType = std::conditional_t<(std::is_const_v<ComponentTs> && ...), const ArchetypeTable, ArchetypeTable>;
+    // Archetype type with the constness of the table, archetype columns propagate it.
+    using ArchetypeType = std::conditional_t<std::is_const_v<TableType>, const Archetype, Archetype>;
+
+    explicit ArchetypeView(TableType& table)
+        : table_(&table),
+          signature_(table.template GetSignature<std::remove_const_t<ComponentTs>...>()),
+          bits_{table.template GetComponentBit<std::remove_const_t<ComponentTs>>()...}
+    {
+    }
+
+    /**
+     * @brief Call a function for each chunk of matching archetypes.
+     *
+     * @param f Function with the signature void(size_t count, const Entity* entities, ComponentTs*... columns).
+     **/
+    template <typename F>
+    void ForEachChunk(F&& f) const;
+
+    /**
+     * @brief Call a function for each matching entity.
+     *
+     * @param f Function with the signature void(Entity, ComponentTs&...).
+     **/
+    template <typename F>
+    void ForEach(F&& f) const;
+
+    /**
+     * @brief Call a function for each entity in a chunk of a matching archetype.
+     *
+     * @param archetype Archetype having all the components of the view.
+     * @param chunk Chunk index.
+     * @param f Function with the signature void(Entity, ComponentTs&...).
+     **/
+    template <typename F>
+    void ForEach(ArchetypeType& archetype, size_t chunk, F&& f) const
+    {
+        ForEachInChunk(archetype, chunk, f, std::index_sequence_for<ComponentTs...>());
+    }
+
+    // True if archetype has all the components of the view.
+    bool Matches(const Archetype& archetype) const noexcept
+    {
+        return (archetype.signature() & signature_) == signature_;
+    }
+
+    // Signature of the components in the view.
+    ArchetypeSignature signature() const noexcept { return signature_; }
+
+    // Table the view iterates.
+    TableType& table() const noexcept { return *table_; }
+
+private:
+    template <typename F, size_t... I>
+    void ForEachChunkImpl(F& f, std::index_sequence<I...>) const;
+
+    template <typename F, size_t... I>
+    void ForEachInChunk(ArchetypeType& archetype, size_t chunk, F& f, std::index_sequence<I...>) const
+    {
+        auto count    = archetype.chunk_size(chunk);
+        auto entities = archetype.entities(chunk);
+        auto columns  = std::make_tuple(reinterpret_cast<ComponentTs*>(archetype.column(chunk, bits_[I]))...);
+
+        for (auto i = 0u; i < count; ++i) { f(entities[i], std::get<I>(columns)[i]...); }
+    }
+
+    TableType*                                 table_;
+    ArchetypeSignature                         signature_;
+    std::array<size_t, sizeof...(ComponentTs)> bits_;
+};
+
+/**
+ * @brief Component storage facade over an ArchetypeTable.
+ *
+ * Registering a component with this storage type places it into the world archetype table, while
+ * ComponentAccess::Read/Write and World component API keep working (without indexed access).
+ * Components of the same entity stored in the table are co-located in archetype chunks and can be
+ * iterated with ArchetypeView.
+ **/
+template <typename T>
+class ArchetypeComponentStorage : public ComponentStorageBase
+{
+public:
+    explicit ArchetypeComponentStorage(ArchetypeTable& table) : table_(table), bit_(table.RegisterComponent<T>()) {}
+    ~ArchetypeComponentStorage() override = default;
+
+    ArchetypeComponentStorage(const ArchetypeComponentStorage&) = delete;
+    ArchetypeComponentStorage& operator=(const ArchetypeComponentStorage&) = delete;
+
+    // Get collection size.
+    size_t size() const override { return table_.GetNumComponents(bit_); }
+
+    // True if entity has a component in this collection.
+    bool HasComponent(Entity entity) const override { return table_.HasComponent(entity, bit_); }
+
+    // Remove component from entity.
+    void RemoveComponent(Entity entity) override { table_.RemoveComponent(entity, bit_); }
+
+    // Archetype chunks are allocated on demand, nothing to reserve.
+    void Reserve(size_t) override {}
+
+    // Add a copy of the component of source entity to every entity of a range, entities migrate to the
+    // new archetype once per archetype component. World::CreateEntities uses ArchetypeTable::CloneEntity instead.
+    void CloneComponent(Entity source, const EntityRange& entities) override
+    {
+        detail::CloneComponent<T>(*this, source, entities);
+    }
+
+    // Get component for entity, throws std::runtime_error if
+    // HasComponent(entity) == false.
+    T&       GetComponent(Entity entity);
+    const T& GetComponent(Entity entity) const;
+
+    // Get pointer to a component for entity or nullptr if entity does not have a component.
+    T*       FindComponent(Entity entity) { return static_cast<T*>(table_.FindComponent(entity, bit_)); }
+    const T* FindComponent(Entity entity) const { return static_cast<T*>(table_.FindComponent(entity, bit_)); }
+
+    // Add a value-initialized component to an entity.
+    T& AddComponent(Entity entity) { return EmplaceComponent(entity); }
+
+    // Add a component to an entity constructing it in place from args.
+    template <typename... Args>
+    T& EmplaceComponent(Entity entity, Args&&... args);
+
+    // Add a copy of value to every entity of a range.
+    void AddComponents(const EntityRange& entities, const T& value);
+
+private:
+    ArchetypeTable& table_;
+    size_t          bit_;
+};
+
+template <typename T>
+inline ColumnType ColumnType::Create()
+{
+    static_assert(std::is_move_constructible_v<T>, "ColumnType: archetype components should be move constructible");
+
+    ColumnType type;
+    type.size           = sizeof(T);
+    type.alignment      = alignof(T);
+    type.move_construct = [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); };
+    if constexpr (std::is_copy_constructible_v<T>)
+    {
+        type.copy_construct = [](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); };
+    }
+    type.destroy        = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+    return type;
+}
+
+inline size_t Archetype::chunk_size(size_t chunk) const noexcept
+{
+    return std::min(chunk_capacity_, size_ - chunk * chunk_capacity_);
+}
+
+inline std::byte* Archetype::component(size_t row, size_t bit) noexcept
+{
+    return column(row / chunk_capacity_, bit) + (row % chunk_capacity_) * types_[bit].size;
+}
+
+inline const std::byte* Archetype::component(size_t row, size_t bit) const noexcept
+{
+    return column(row / chunk_capacity_, bit) + (row % chunk_capacity_) * types_[bit].size;
+}
+
+template <typename T>
+inline size_t ArchetypeTable::RegisterComponent()
+{
+    auto id = GetComponentTypeId<T>();
+
+    if (id < bits_.size() && bits_[id] != kInvalidComponentBit)
+    {
+        throw std::runtime_error("ArchetypeTable: component type already registered");
+    }
+
+    if (types_.size() == kMaxArchetypeComponents)
+    {
+        throw std::runtime_error("ArchetypeTable: too many component types");
+    }
+
+    auto bit = types_.size();
+    types_.push_back(ColumnType::Create<T>());
+    counts_.push_back(0);
+
+    if (id >= bits_.size())
+    {
+        bits_.resize(id + 1, kInvalidComponentBit);
+    }
+
+    bits_[id] = bit;
+    return bit;
+}
+
+template <typename T>
+inline size_t ArchetypeTable::GetComponentBit() const
+{
+    auto id = GetComponentTypeId<T>();
+
+    if (id >= bits_.size() || bits_[id] == kInvalidComponentBit)
+    {
+        throw std::runtime_error("ArchetypeTable: component type not registered");
+    }
+
+    return bits_[id];
+}
+
+template <typename F>
+inline void* ArchetypeTable::AddComponent(Entity entity, size_t bit, F&& construct)
+{
+    auto& location  = GetLocation(entity);
+    auto  signature = location.archetype ? location.archetype->signature() : ArchetypeSignature(0);
+
+    if ((signature >> bit) & 1u)
+    {
+        throw std::runtime_error("ArchetypeTable: Entity already has a component");
+    }
+
+    auto& dst       = GetArchetype(signature | (ArchetypeSignature(1) << bit));
+    auto  row       = dst.Allocate(entity);
+    auto  component = dst.component(row, bit);
+
+    // Construct the new component first, so nothing needs to be undone if construction throws.
+    try
+    {
+        construct(component);
+    }
+    catch (...)
+    {
+        dst.Abandon();
+        throw;
+    }
+
+    Move(entity, dst, row);
+    ++counts_[bit];
+    return component;
+}
+
+template <typename F>
+inline void ArchetypeTable::AddEntities(const EntityRange& entities, ArchetypeSignature signature, F&& construct)
+{
+    for (auto entity : entities)
+    {
+        if (GetLocation(entity).archetype)
+        {
+            throw std::runtime_error("ArchetypeTable: Entity already has a component");
+        }
+    }
+
+    auto& dst = GetArchetype(signature);
+
+    for (auto entity : entities)
+    {
+        auto row  = dst.Allocate(entity);
+        auto bits = signature;
+
+        try
+        {
+            for (; bits; bits &= bits - 1)
+            {
+                auto bit = CountTrailingZeros(bits);
+                construct(bit, dst.component(row, bit));
+            }
+        }
+        catch (...)
+        {
+            // Destroy components constructed before the throwing one.
+            for (auto done = signature & ~bits; done; done &= done - 1)
+            {
+                auto bit = CountTrailingZeros(done);
+                types_[bit].destroy(dst.component(row, bit));
+            }
+            dst.Abandon();
+            throw;
+        }
+
+        locations_[GetEntityIndex(entity)] = EntityLocation{&dst, row};
+        for (auto added = signature; added; added &= added - 1) { ++counts_[CountTrailingZeros(added)]; }
+    }
+}
+
+template <typename... ComponentTs>
+template <typename F>
+inline void ArchetypeView<ComponentTs...>::ForEachChunk(F&& f) const
+{
+    ForEachChunkImpl(f, std::index_sequence_for<ComponentTs...>());
+}
+
+template <typename... ComponentTs>
+template <typename F, size_t... I>
+inline void ArchetypeView<ComponentTs...>::ForEachChunkImpl(F& f, std::index_sequence<I...>) const
+{
+    for (auto& archetype_ptr : table_->archetypes())
+    {
+        ArchetypeType& archetype = *archetype_ptr;
+
+        if (!Matches(archetype))
+        {
+            continue;
+        }
+
+        for (auto chunk = 0u; chunk < archetype.num_chunks(); ++chunk)
+        {
+            f(archetype.chunk_size(chunk),
+              static_cast<const Entity*>(archetype.entities(chunk)),
+              reinterpret_cast<ComponentTs*>(archetype.column(chunk, bits_[I]))...);
+        }
+    }
+}
+
+template <typename... ComponentTs>
+template <typename F>
+inline void ArchetypeView<ComponentTs...>::ForEach(F&& f) const
+{
+    for (auto& archetype_ptr : table_->archetypes())
+    {
+        ArchetypeType& archetype = *archetype_ptr;
+
+        if (Matches(archetype))
+        {
+            for (auto chunk = 0u; chunk < archetype.num_chunks(); ++chunk) { ForEach(archetype, chunk, f); }
+        }
+    }
+}
+
+template <typename T>
+template <typename... Args>
+inline T& ArchetypeComponentStorage<T>::EmplaceComponent(Entity entity, Args&&... args)
+{
+    return *static_cast<T*>(
+        table_.AddComponent(entity, bit_, [&args...](void* ptr) { new (ptr) T(std::forward<Args>(args)...); }));
+}
+
+template <typename T>
+inline void ArchetypeComponentStorage<T>::AddComponents(const EntityRange& entities, const T& value)
+{
+    for (auto entity : entities)
+    {
+        table_.AddComponent(entity, bit_, [&value](void* ptr) { new (ptr) T(value); });
+    }
+}
+
+template <typename T>
+inline T& ArchetypeComponentStorage<T>::GetComponent(Entity entity)
+{
+    auto component = FindComponent(entity);
+
+    if (!component)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return *component;
+}
+
+template <typename T>
+inline const T& ArchetypeComponentStorage<T>::GetComponent(Entity entity) const
+{
+    auto component = FindComponent(entity);
+
+    if (!component)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return *component;
+}
+}  // namespace yecs
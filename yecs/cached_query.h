@@ -0,0 +1,116 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <memory_resource>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/entity_set.h"
+#include "yecs/sparse_set.h"
+
+namespace yecs
+{
+/** @brief Entities having all of the components of a signature, kept up to date by World.
+ *
+ * Cached queries are registered in World (World::RegisterQuery, EntityQuery::Cached) and updated incrementally
+ * whenever components are added or removed and entities are created or destroyed, so iterating a query costs
+ * no matching work. Matching entities are packed in no particular order, the order changes as entities leave
+ * the query. Query should not be iterated while structural changes are being made.
+ **/
+class CachedQuery
+{
+public:
+    explicit CachedQuery(const ComponentMask&       mask,
+                         std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : mask_(mask), entities_(resource)
+    {
+    }
+
+    CachedQuery(const CachedQuery&) = delete;
+    CachedQuery& operator=(const CachedQuery&) = delete;
+
+    // Components an entity should have to match the query.
+    const ComponentMask& mask() const noexcept { return mask_; }
+
+    // True if component mask matches the query.
+    bool Matches(const ComponentMask& mask) const noexcept { return (mask & mask_) == mask_; }
+
+    // Number of matching entities.
+    size_t size() const { return entities_.size(); }
+    bool   empty() const { return entities_.size() == 0; }
+
+    // True if entity matches the query.
+    bool Contains(Entity entity) const
+    {
+        auto index = entities_.IndexOf(entity);
+        return index != kInvalidComponentIndex && entities_.entity(index) == entity;
+    }
+
+    // Matching entities.
+    const std::pmr::vector<Entity>& entities() const { return entities_.entities(); }
+
+    auto begin() const { return entities_.entities().cbegin(); }
+    auto end() const { return entities_.entities().cend(); }
+
+    // Lazy pipeline over matching entities, see EntityPipeline.
+    EntityPipeline<> Lazy() const
+    {
+        auto& entities = entities_.entities();
+        return EntityPipeline<>(
+            entities.data(), entities.data() + entities.size(), false, entities.get_allocator().resource());
+    }
+
+private:
+    // Move an entity in or out of the query when its component mask changes from before to after.
+    void Update(Entity entity, const ComponentMask& before, const ComponentMask& after)
+    {
+        auto matched = Matches(before);
+        auto matches = Matches(after);
+
+        if (matches && !matched)
+        {
+            entities_.Insert(entity);
+        }
+        else if (matched && !matches)
+        {
+            entities_.Remove(entity);
+        }
+    }
+
+    // Add a batch of entities known to match the query.
+    void Insert(const EntityRange& entities)
+    {
+        entities_.Reserve(entities_.size() + entities.size());
+        for (auto entity : entities) { entities_.Insert(entity); }
+    }
+
+    // Components required.
+    ComponentMask mask_;
+    // Matching entities.
+    SparseSet entities_;
+
+    friend class World;
+};
+}  // namespace yecs
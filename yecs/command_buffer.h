@@ -0,0 +1,153 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+#include "yecs/entity_allocator.h"
+
+namespace yecs
+{
+/** @brief Records structural changes to be applied to the World later.
+ *
+ * Systems running in parallel can not create or destroy entities or add and remove components directly,
+ * since this mutates storages other systems might be iterating. Instead they record these operations into
+ * a command buffer obtained from ComponentAccess::Commands(). Every thread gets its own buffer, so recording
+ * does not take any locks. Recorded commands are played back by World::FlushCommands, which World::Run
+ * calls once all the systems have finished.
+ *
+ * Playback is batched: entities are created first, then component commands are applied grouped by component
+ * storage (preserving recording order for the same entity and component), then entities are destroyed.
+ * Commands targeting entities which are not alive at playback time are ignored.
+ *
+ * Entity indices are reserved at record time. Every buffer holds a batch of indices of destroyed entities,
+ * refilled by World::FlushCommands up to the number of entities the buffer created in the last frame, and
+ * only reserves fresh indices once the batch runs out, so spawning and despawning every frame reuses slots.
+ **/
+class CommandBuffer
+{
+public:
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    // Create an entity. Returned handle is valid immediately and can be used in subsequent commands
+    // or stored in components, but the entity becomes alive only once commands are played back.
+    Entity CreateEntity();
+
+    // Add a component to an entity, if the entity already has a component it is overwritten.
+    template <typename ComponentT>
+    void AddComponent(Entity entity, ComponentT component = ComponentT());
+
+    // Remove a component from an entity, does nothing if the entity does not have a component.
+    template <typename ComponentT>
+    void RemoveComponent(Entity entity);
+
+    // Destroy an entity along with its components.
+    void DestroyEntity(Entity entity) { destroyed_.push_back(entity); }
+
+    // True if no commands have been recorded.
+    bool empty() const { return created_.empty() && commands_.empty() && destroyed_.empty(); }
+
+private:
+    // Type erased component value.
+    using ValuePtr = std::unique_ptr<void, void (*)(void*)>;
+
+    // Component add or remove command.
+    struct Command
+    {
+        TypeId          component;
+        Entity          entity;
+        // Component value to add, nullptr for remove commands.
+        ValuePtr value;
+        // Move value into a storage.
+        void (*add)(ComponentStorageBase& storage, Entity entity, void* value);
+    };
+
+    // Only World can create command buffers.
+    explicit CommandBuffer(EntityAllocator& entity_allocator) noexcept : entity_allocator_(entity_allocator) {}
+
+    // Entity indices are reserved from World allocator at record time.
+    EntityAllocator& entity_allocator_;
+    // Destroyed entities (with their current generation) to be handed out before fresh indices.
+    std::vector<Entity> recycled_;
+    // Number of entities created since the last playback, recycled_ is refilled up to this number.
+    size_t num_created_ = 0;
+    // Recorded commands.
+    std::vector<EntityIndex> created_;
+    std::vector<Command>     commands_;
+    std::vector<Entity>      destroyed_;
+
+    friend class World;
+};
+
+inline Entity CommandBuffer::CreateEntity()
+{
+    if (recycled_.empty())
+    {
+        auto index = entity_allocator_.Reserve();
+        created_.push_back(index);
+        // Fresh indices have never been used, so their generation is 0.
+        return MakeEntity(index, 0);
+    }
+
+    auto entity = recycled_.back();
+    recycled_.pop_back();
+    created_.push_back(GetEntityIndex(entity));
+    return entity;
+}
+
+template <typename ComponentT>
+inline void CommandBuffer::AddComponent(Entity entity, ComponentT component)
+{
+    auto add = [](ComponentStorageBase& storage, Entity entity, void* value) {
+        auto& typed_storage = static_cast<ComponentStorageType<ComponentT>&>(storage);
+        auto  existing      = typed_storage.FindComponent(entity);
+        auto& typed_value   = *static_cast<ComponentT*>(value);
+
+        if (existing)
+        {
+            *existing = std::move(typed_value);
+        }
+        else
+        {
+            typed_storage.EmplaceComponent(entity, std::move(typed_value));
+        }
+    };
+
+    auto destroy = [](void* value) { delete static_cast<ComponentT*>(value); };
+
+    commands_.push_back(Command{
+        GetComponentTypeId<ComponentT>(), entity, ValuePtr(new ComponentT(std::move(component)), destroy), add});
+}
+
+template <typename ComponentT>
+inline void CommandBuffer::RemoveComponent(Entity entity)
+{
+    commands_.push_back(Command{GetComponentTypeId<ComponentT>(), entity, ValuePtr(nullptr, nullptr), nullptr});
+}
+}  // namespace yecs
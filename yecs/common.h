@@ -23,33 +23,230 @@ SOFTWARE.
 ****************************************************************************/
 #pragma once
 
+#include <atomic>
+#include <bitset>
+#include <cstddef>
 #include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <iterator>
 #include <numeric>
-#include <typeindex>
-#include <typeinfo>
+#include <type_traits>
 #include <vector>
 
 namespace yecs
 {
-constexpr std::size_t   kInvalidComponentIndex = ~0u;
-constexpr std::uint32_t kInvalidEntity         = ~0u;
-
 using std::size_t;
 using std::uint32_t;
+using std::uint64_t;
+
+/**
+ * Entity handle packs an index of an entity slot and a generation of this slot. Generation is incremented
+ * every time an entity is destroyed, so stale handles never alias entities reusing the same slot.
+ * Index occupies the high bits, so handles of live entities are ordered by their index.
+ *
+ * 32-bit handles (default) use 24 bits for index and 8 bits for generation,
+ * 64-bit handles (YECS_64BIT_ENTITY defined) use 32 bits for both.
+ **/
+#ifdef YECS_64BIT_ENTITY
+using Entity                             = uint64_t;
+constexpr uint32_t kEntityGenerationBits = 32;
+#else
+using Entity                             = uint32_t;
+constexpr uint32_t kEntityGenerationBits = 8;
+#endif
+using EntityIndex      = uint32_t;
+using EntityGeneration = uint32_t;
+
+constexpr std::size_t kInvalidComponentIndex = ~0u;
+constexpr Entity      kInvalidEntity         = ~Entity(0);
+
+// Generation wraps around after this value.
+constexpr EntityGeneration kMaxEntityGeneration =
+    static_cast<EntityGeneration>((Entity(1) << kEntityGenerationBits) - 1);
+// Largest valid entity index (all ones index is reserved for kInvalidEntity).
+constexpr EntityIndex kMaxEntityIndex = static_cast<EntityIndex>((kInvalidEntity >> kEntityGenerationBits) - 1);
+
+// Get slot index of an entity.
+constexpr EntityIndex GetEntityIndex(Entity entity)
+{
+    return static_cast<EntityIndex>(entity >> kEntityGenerationBits);
+}
+
+// Get generation of an entity.
+constexpr EntityGeneration GetEntityGeneration(Entity entity)
+{
+    return static_cast<EntityGeneration>(entity & kMaxEntityGeneration);
+}
+
+// Compose entity handle from slot index and generation.
+constexpr Entity MakeEntity(EntityIndex index, EntityGeneration generation)
+{
+    return (static_cast<Entity>(index) << kEntityGenerationBits) | generation;
+}
+
+/**
+ * @brief Contiguous range of entity indices [first, first + size) sharing the same generation.
+ *
+ * Returned by World::CreateEntities, entities of the range can be iterated or accessed by position.
+ **/
+class EntityRange
+{
+public:
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = Entity;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Entity*;
+        using reference         = Entity;
+
+        Iterator(EntityIndex index, EntityGeneration generation) noexcept : index_(index), generation_(generation) {}
+
+        Entity    operator*() const noexcept { return MakeEntity(index_, generation_); }
+        Iterator& operator++() noexcept
+        {
+            ++index_;
+            return *this;
+        }
+        Iterator operator++(int) noexcept { return Iterator(index_++, generation_); }
+
+        bool operator==(const Iterator& rhs) const noexcept { return index_ == rhs.index_; }
+        bool operator!=(const Iterator& rhs) const noexcept { return index_ != rhs.index_; }
+
+    private:
+        EntityIndex      index_;
+        EntityGeneration generation_;
+    };
+
+    EntityRange() noexcept = default;
+    EntityRange(EntityIndex first, size_t size, EntityGeneration generation = 0) noexcept
+        : first_(first), size_(size), generation_(generation)
+    {
+    }
+
+    // Number of entities in the range.
+    size_t size() const noexcept { return size_; }
+    bool   empty() const noexcept { return size_ == 0; }
+
+    // Index of the first entity.
+    EntityIndex first() const noexcept { return first_; }
+
+    // Entity at a position in the range.
+    Entity operator[](size_t i) const noexcept { return MakeEntity(first_ + static_cast<EntityIndex>(i), generation_); }
+
+    // True if entity belongs to the range (generation included).
+    bool Contains(Entity entity) const noexcept
+    {
+        auto index = GetEntityIndex(entity);
+        return index >= first_ && index - first_ < size_ && GetEntityGeneration(entity) == generation_;
+    }
+
+    Iterator begin() const noexcept { return Iterator(first_, generation_); }
+    Iterator end() const noexcept { return Iterator(first_ + static_cast<EntityIndex>(size_), generation_); }
+
+private:
+    EntityIndex      first_      = 0;
+    size_t           size_       = 0;
+    EntityGeneration generation_ = 0;
+};
+
+// Number of trailing zero bits in a non-zero value.
+inline uint32_t CountTrailingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+// Number of set bits in a value.
+inline uint32_t PopCount(uint64_t value)
+{
+#ifdef _MSC_VER
+    return static_cast<uint32_t>(__popcnt64(value));
+#else
+    return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+}
 
-using Entity         = uint32_t;
 using ComponentIndex = size_t;
-using ComponentTypes = std::vector<std::type_index>;
+
+// World tick, incremented once per World::Run.
+using Tick = uint32_t;
+
+// Dense type id, see GetComponentTypeId.
+using TypeId = uint32_t;
+
+constexpr TypeId kInvalidTypeId = ~TypeId(0);
+
+using ComponentTypes = std::vector<TypeId>;
+
+// Maximum number of component types registered in a World, configured with YECS_MAX_COMPONENT_TYPES.
+#ifndef YECS_MAX_COMPONENT_TYPES
+#define YECS_MAX_COMPONENT_TYPES 64
+#endif
+constexpr size_t kMaxComponentTypes = YECS_MAX_COMPONENT_TYPES;
+
+// Set of component types of an entity, bits are assigned by World at component registration.
+using ComponentMask = std::bitset<kMaxComponentTypes>;
+
+// Bit of a component type which is not registered.
+constexpr size_t kInvalidComponentBit = ~size_t(0);
+
+/**
+ * @brief Generates dense per-process type ids.
+ *
+ * Ids are assigned sequentially on first use of a type, independently for every FamilyT,
+ * so they can be used to index flat arrays instead of hash maps.
+ **/
+template <typename FamilyT>
+class TypeIdFamily
+{
+public:
+    template <typename T>
+    static TypeId Get() noexcept
+    {
+        static const TypeId id = next_.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+private:
+    static inline std::atomic<TypeId> next_{0};
+};
+
+namespace detail
+{
+struct ComponentFamily;
+struct SystemFamily;
+}  // namespace detail
+
+/**
+ * @brief Get dense id of a component type.
+ *
+ * @tparam T Component type, cv-qualifiers are ignored.
+ * @return Id unique among component types.
+ **/
+template <typename T>
+inline TypeId GetComponentTypeId() noexcept
+{
+    return TypeIdFamily<detail::ComponentFamily>::Get<std::remove_cv_t<T>>();
+}
 
 /**
- * @brief Calculate hasheable index given a type.
+ * @brief Get dense id of a system type.
  *
- * @tparam The type user wants a hasheable index for.
- * @return std::type_index which can be used in hash maps.
+ * @tparam T System type.
+ * @return Id unique among system types.
  **/
 template <typename T>
-inline auto GetTypeIndex()
+inline TypeId GetSystemTypeId() noexcept
 {
-    return std::type_index(typeid(T));
+    return TypeIdFamily<detail::SystemFamily>::Get<T>();
 }
 }  // namespace yecs
@@ -23,10 +23,15 @@ SOFTWARE.
 ****************************************************************************/
 #pragma once
 
-#include <unordered_map>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "yecs/common.h"
+#include "yecs/entity_bitset.h"
+#include "yecs/sparse_set.h"
 
 namespace yecs
 {
@@ -43,112 +48,233 @@ public:
     // Collection size
     virtual size_t size() const = 0;
 
-    // True if entity has a component in this collection
+    // True if entity has a component in this collection.
+    // Storages are keyed on entity index, liveness of an entity handle is checked by World::IsAlive.
     virtual bool HasComponent(Entity entity) const = 0;
 
     // Remove component from entity.
     virtual void RemoveComponent(Entity entity) = 0;
+
+    // Remove components from a batch of entities, every entity should have a component.
+    virtual void RemoveComponents(const Entity* entities, size_t count)
+    {
+        for (auto i = 0u; i < count; ++i) { RemoveComponent(entities[i]); }
+    }
+
+    // Reserve space for at least capacity components.
+    virtual void Reserve(size_t capacity) = 0;
+
+    // Add a copy of the component of source entity to every entity of a range,
+    // throws std::runtime_error if the component is not copy constructible.
+    virtual void CloneComponent(Entity source, const EntityRange& entities) = 0;
 };
 
 /** @brief Component storage storing entities in a dense array.
  *
- * Components are stored in dense array and hash map is being used for entity to component mapping.
+ * Components are stored in dense array parallel to the packed entity array of a SparseSet, which maps
+ * the index part of an entity (see GetEntityIndex) to a component with a direct paged array lookup.
+ * Removal is O(1) swap-and-pop, batches are removed by marking their slots and compacting in one pass.
  **/
 template <typename T>
 class DenseComponentStorage : public ComponentStorageBase
 {
 public:
-    DenseComponentStorage()           = default;
+    explicit DenseComponentStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : index_(resource), components_(resource)
+    {
+    }
     ~DenseComponentStorage() override = default;
 
     DenseComponentStorage(const DenseComponentStorage&) = delete;
     DenseComponentStorage& operator=(const DenseComponentStorage&) = delete;
 
-    DenseComponentStorage(DenseComponentStorage&&);
-    DenseComponentStorage&& operator=(DenseComponentStorage&&);
+    DenseComponentStorage(DenseComponentStorage&&) = default;
+    DenseComponentStorage& operator=(DenseComponentStorage&&) = default;
 
     // Get collection size.
     size_t size() const override { return components_.size(); }
 
     // True if entity has a component in this collection.
-    bool HasComponent(Entity entity) const override;
+    bool HasComponent(Entity entity) const override { return index_.Contains(entity); }
 
     // Remove component from entity.
     void RemoveComponent(Entity entity) override;
 
+    // Remove components from a batch of entities compacting the storage in one pass.
+    void RemoveComponents(const Entity* entities, size_t count) override;
+
+    // Reserve space for at least capacity components.
+    void Reserve(size_t capacity) override;
+
+    // Add a copy of the component of source entity to every entity of a range.
+    void CloneComponent(Entity source, const EntityRange& entities) override;
+
     // Get component for entity, throws std::runtime_error if
     // HasComponent(entity) == false.
     T&       GetComponent(Entity entity);
     const T& GetComponent(Entity entity) const;
 
-    // Add a component to an entity.
-    T& AddComponent(Entity entity);
+    // Get pointer to a component for entity or nullptr if entity does not have a component.
+    T*       FindComponent(Entity entity);
+    const T* FindComponent(Entity entity) const;
+
+    // Add a value-initialized component to an entity.
+    T& AddComponent(Entity entity) { return EmplaceComponent(entity); }
+
+    // Add a component to an entity constructing it in place from args.
+    template <typename... Args>
+    T& EmplaceComponent(Entity entity, Args&&... args);
+
+    // Add a copy of value to every entity of a range, none of them should have a component.
+    void AddComponents(const EntityRange& entities, const T& value);
 
     // Access component by index.
     T&       operator[](ComponentIndex index);
     const T& operator[](ComponentIndex index) const;
 
+    // Entity owning a component at index.
+    Entity entity(ComponentIndex index) const { return index_.entity(index); }
+
 private:
-    std::unordered_map<Entity, ComponentIndex> component_index_;
-    std::vector<T>                             components_;
+    SparseSet           index_;
+    std::pmr::vector<T> components_;
 };
 
-inline ComponentStorageBase::~ComponentStorageBase() {}
+template <typename T>
+class TagStorage;
 
+/** @brief Selects a storage type for a component.
+ *
+ * World stores every component in this storage type. Empty types are stored in TagStorage, other types
+ * in DenseComponentStorage. Specialize this template to make World use a different storage for a component:
+ * template <> struct ComponentStorageTraits<Position> { using StorageType = PagedComponentStorage<Position>; };
+ **/
 template <typename T>
-inline DenseComponentStorage<T>::DenseComponentStorage(DenseComponentStorage&& rhs)
-    : component_index_(std::move(rhs.component_index_)), components_(std::move(rhs.components_))
+struct ComponentStorageTraits
 {
-}
+    using StorageType = std::conditional_t<std::is_empty_v<T>, TagStorage<T>, DenseComponentStorage<T>>;
+};
 
+// Storage type used for a component by default.
 template <typename T>
-inline DenseComponentStorage<T>&& DenseComponentStorage<T>::operator=(DenseComponentStorage&& rhs)
+using ComponentStorageType = typename ComponentStorageTraits<T>::StorageType;
+
+// True if a storage provides indexed access (operator[] and entity(index)), tag storages do not.
+template <typename StorageT, typename = void>
+struct IsIndexedStorage : std::false_type
 {
-    component_index_ = std::move(rhs.component_index_);
-    components_      = std::move(rhs.components_);
-}
+};
 
-template <typename T>
-inline bool DenseComponentStorage<T>::HasComponent(Entity entity) const
+template <typename StorageT>
+struct IsIndexedStorage<StorageT, std::void_t<decltype(std::declval<const StorageT&>().entity(ComponentIndex()))>>
+    : std::true_type
 {
-    return component_index_.find(entity) != component_index_.cend();
+};
+
+inline ComponentStorageBase::~ComponentStorageBase() {}
+
+namespace detail
+{
+// Implementation of ComponentStorageBase::CloneComponent in terms of GetComponent and AddComponents.
+template <typename T, typename StorageT>
+inline void CloneComponent(StorageT& storage, Entity source, const EntityRange& entities)
+{
+    if constexpr (std::is_copy_constructible_v<T>)
+    {
+        // Copy the prototype first, adding components might relocate the source.
+        const T value = storage.GetComponent(source);
+        storage.AddComponents(entities, value);
+    }
+    else
+    {
+        throw std::runtime_error("ComponentCollection: component is not copy constructible");
+    }
 }
+}  // namespace detail
 
 template <typename T>
-inline T& DenseComponentStorage<T>::AddComponent(Entity entity)
+template <typename... Args>
+inline T& DenseComponentStorage<T>::EmplaceComponent(Entity entity, Args&&... args)
 {
     if (HasComponent(entity))
     {
         throw std::runtime_error("ComponentCollection: Entity already has a component");
     }
 
-    component_index_[entity] = components_.size();
-    components_.emplace_back();
+    // Construct first, so a throwing constructor leaves the storage unchanged.
+    components_.emplace_back(std::forward<Args>(args)...);
+    index_.Insert(entity);
     return components_.back();
 }
 
+template <typename T>
+inline void DenseComponentStorage<T>::AddComponents(const EntityRange& entities, const T& value)
+{
+    for (auto entity : entities)
+    {
+        if (HasComponent(entity))
+        {
+            throw std::runtime_error("ComponentCollection: Entity already has a component");
+        }
+    }
+
+    Reserve(components_.size() + entities.size());
+
+    for (auto entity : entities) { index_.Insert(entity); }
+    components_.insert(components_.end(), entities.size(), value);
+}
+
+template <typename T>
+inline void DenseComponentStorage<T>::Reserve(size_t capacity)
+{
+    index_.Reserve(capacity);
+    components_.reserve(capacity);
+}
+
+template <typename T>
+inline void DenseComponentStorage<T>::CloneComponent(Entity source, const EntityRange& entities)
+{
+    detail::CloneComponent<T>(*this, source, entities);
+}
+
+template <typename T>
+inline const T* DenseComponentStorage<T>::FindComponent(Entity entity) const
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? &components_[index] : nullptr;
+}
+
+template <typename T>
+inline T* DenseComponentStorage<T>::FindComponent(Entity entity)
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? &components_[index] : nullptr;
+}
+
 template <typename T>
 inline const T& DenseComponentStorage<T>::GetComponent(Entity entity) const
 {
-    if (!HasComponent(entity))
+    auto component = FindComponent(entity);
+
+    if (!component)
     {
         throw std::runtime_error("ComponentCollection: Entity does not have a component");
     }
 
-    ComponentIndex index = component_index_.find(entity)->second;
-    return components_[index];
+    return *component;
 }
 
 template <typename T>
 inline T& DenseComponentStorage<T>::GetComponent(Entity entity)
 {
-    if (!HasComponent(entity))
+    auto component = FindComponent(entity);
+
+    if (!component)
     {
         throw std::runtime_error("ComponentCollection: Entity does not have a component");
     }
 
-    ComponentIndex index = component_index_[entity];
-    return components_[index];
+    return *component;
 }
 
 template <typename T>
@@ -159,25 +285,25 @@ inline void DenseComponentStorage<T>::RemoveComponent(Entity entity)
         throw std::runtime_error("ComponentCollection: Entity does not have a component");
     }
 
-    if (components_.size() > 1)
-    {
-        ComponentIndex last_index = components_.size() - 1;
-        ComponentIndex index      = component_index_[entity];
-
-        std::swap(components_[index], components_[last_index]);
+    // Move the last component into the vacated slot, like the set does with its entities.
+    auto index = index_.Remove(entity);
 
-        for (auto& ci : component_index_)
-        {
-            if (ci.second == last_index)
-            {
-                ci.second = index;
-                break;
-            }
-        }
+    if (index != components_.size() - 1)
+    {
+        components_[index] = std::move(components_.back());
     }
 
-    component_index_.erase(entity);
-    components_.resize(components_.size() - 1);
+    components_.pop_back();
+}
+
+template <typename T>
+inline void DenseComponentStorage<T>::RemoveComponents(const Entity* entities, size_t count)
+{
+    // The set validates the batch, marks removed slots and fills them from the tail in one pass.
+    index_.Remove(entities, count, [this](ComponentIndex from, ComponentIndex to) {
+        components_[to] = std::move(components_[from]);
+    });
+    components_.erase(components_.begin() + index_.size(), components_.end());
 }
 
 template <typename T>
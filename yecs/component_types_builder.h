@@ -14,7 +14,7 @@ template <typename... Args>
 class ComponentTypesBuilder
 {
 public:
-    ComponentTypesBuilder() : types{typeid(Args)...} {}
+    ComponentTypesBuilder() : types{GetComponentTypeId<Args>()...} {}
     // Return component types.
     ComponentTypes Build() const& { return types; }
     // Return component types with R-value optimization.
@@ -0,0 +1,756 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/entity_set.h"
+
+namespace yecs
+{
+/** @brief Compressed set of entities for queries over huge worlds.
+ *
+ * Entity indices are split into blocks of 65536, every non-empty block is stored in a container of the
+ * smallest of three kinds, chosen by density when the block is built: a sorted array of 16-bit offsets
+ * (sparse blocks), a 8 KiB bitmap (dense blocks) or a list of runs (long ranges of consecutive entities).
+ * A world of 10M entities matching a query takes at most 1.3 MB instead of 40 MB of a plain EntitySet.
+ *
+ * Only indices are stored, entity handles are composed with the current generations of world slots, so
+ * the set should not outlive the frame it has been queried in (see EntityQuery::MatchCompressed).
+ **/
+class CompressedEntitySet
+{
+public:
+    // Number of bits of an entity index addressing an entity within a block.
+    static constexpr uint32_t kBlockBits = 16;
+    static constexpr uint32_t kBlockSize = 1u << kBlockBits;
+    // Number of bitmap words per block.
+    static constexpr uint32_t kBitmapWords = kBlockSize / 64;
+    // Largest array container, an array of 4096 offsets takes as much memory as a bitmap.
+    static constexpr uint32_t kMaxArraySize = 4096;
+
+    // Container kinds.
+    enum class ContainerType : uint8_t
+    {
+        kArray,
+        kBitmap,
+        kRun
+    };
+
+    class Iterator;
+
+    CompressedEntitySet(const CompressedEntitySet&) = delete;
+    CompressedEntitySet& operator=(const CompressedEntitySet&) = delete;
+
+    CompressedEntitySet(CompressedEntitySet&&) = default;
+    CompressedEntitySet& operator=(CompressedEntitySet&&) = default;
+
+    // Number of entities.
+    size_t size() const noexcept { return size_; }
+    bool   empty() const noexcept { return size_ == 0; }
+
+    // True if entity is in the set.
+    bool Contains(Entity entity) const;
+
+    // Call f(Entity) for every entity in ascending order.
+    template <typename F>
+    void ForEach(F&& f) const;
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    /**
+     * @brief Set operations, blocks present in one of the sets only are copied or skipped without
+     * being looked at, arrays are merged and other blocks are combined 64 entities at a time.
+     * Both sets should come from the same world.
+     **/
+    CompressedEntitySet Intersection(const CompressedEntitySet& rhs) const;
+    CompressedEntitySet Union(const CompressedEntitySet& rhs) const;
+    CompressedEntitySet Difference(const CompressedEntitySet& rhs) const;
+
+    // Sorted EntitySet with the same entities.
+    EntitySet Decompress() const;
+
+    // Bytes taken by containers.
+    size_t memory_usage() const;
+
+    // Containers, for diagnostics.
+    size_t        num_containers() const noexcept { return containers_.size(); }
+    ContainerType container_type(size_t i) const noexcept { return containers_[i].type; }
+
+private:
+    // Entities of a block, containers allocate from the resource of their set.
+    struct Container
+    {
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+        explicit Container(const allocator_type& allocator = {}) : values(allocator), bits(allocator) {}
+        Container(const Container& rhs, const allocator_type& allocator)
+            : key(rhs.key), type(rhs.type), size(rhs.size), values(rhs.values, allocator), bits(rhs.bits, allocator)
+        {
+        }
+        Container(Container&& rhs, const allocator_type& allocator)
+            : key(rhs.key)
+            , type(rhs.type)
+            , size(rhs.size)
+            , values(std::move(rhs.values), allocator)
+            , bits(std::move(rhs.bits), allocator)
+        {
+        }
+        Container(const Container&) = default;
+        Container(Container&&)      = default;
+        Container& operator=(const Container&) = default;
+        Container& operator=(Container&&) = default;
+
+        // Block index (entity index >> kBlockBits).
+        uint32_t key = 0;
+        // Kind of container.
+        ContainerType type = ContainerType::kArray;
+        // Number of entities.
+        uint32_t size = 0;
+        // Sorted offsets for arrays, (start, length - 1) pairs for runs.
+        std::pmr::vector<uint16_t> values;
+        // Bitmap words.
+        std::pmr::vector<uint64_t> bits;
+    };
+
+    class Builder;
+
+    CompressedEntitySet(const std::pmr::vector<EntityGeneration>& generations, std::pmr::memory_resource* resource)
+        : generations_(&generations), containers_(resource)
+    {
+    }
+
+    // Store container in its smallest form.
+    static void Optimize(Container& container);
+    // Expand container into kBitmapWords words.
+    static void ExpandBits(const Container& container, uint64_t* bits);
+    // Fill container from bitmap words, returns false if there are no bits.
+    static bool FromBits(Container& container, const uint64_t* bits);
+
+    // Call f(uint32_t offset) for every entity of a container in ascending order.
+    template <typename F>
+    static void ForEachOffset(const Container& container, F&& f);
+    // Call f(uint32_t begin, uint32_t end) for every range of set bits of a block bitmap.
+    template <typename F>
+    static void ForEachRun(const uint64_t* bits, F&& f);
+
+    // Set operations.
+    enum class Operation
+    {
+        kIntersection,
+        kUnion,
+        kDifference
+    };
+
+    // Combine sets block by block.
+    CompressedEntitySet Combine(const CompressedEntitySet& rhs, Operation operation) const;
+    // Combine two containers having the same key, returns false if the result is empty.
+    static bool Combine(const Container& lhs, const Container& rhs, Operation operation, Container& result);
+
+    // Generations of world slots.
+    const std::pmr::vector<EntityGeneration>* generations_ = nullptr;
+    // Non-empty containers ordered by key.
+    std::pmr::vector<Container> containers_;
+    // Number of entities.
+    size_t size_ = 0;
+
+    friend class EntityQuery;
+};
+
+/**
+ * @brief Forward iterator over entities of a compressed set in ascending order.
+ **/
+class CompressedEntitySet::Iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = Entity;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const Entity*;
+    using reference         = Entity;
+
+    Iterator(const CompressedEntitySet* set, size_t container) : set_(set), container_(container) { Seek(); }
+
+    Entity operator*() const
+    {
+        auto index = (set_->containers_[container_].key << kBlockBits) | offset_;
+        return MakeEntity(index, (*set_->generations_)[index]);
+    }
+
+    Iterator& operator++()
+    {
+        Next();
+        return *this;
+    }
+
+    Iterator operator++(int)
+    {
+        auto it = *this;
+        Next();
+        return it;
+    }
+
+    bool operator==(const Iterator& rhs) const { return container_ == rhs.container_ && offset_ == rhs.offset_; }
+    bool operator!=(const Iterator& rhs) const { return !(*this == rhs); }
+
+private:
+    // Move to the first entity of the current container.
+    void Seek()
+    {
+        position_ = 0;
+        offset_   = 0;
+
+        if (container_ == set_->containers_.size())
+        {
+            return;
+        }
+
+        auto& container = set_->containers_[container_];
+        if (container.type == ContainerType::kBitmap)
+        {
+            while (!container.bits[position_]) { ++position_; }
+            offset_ = position_ * 64 + CountTrailingZeros(container.bits[position_]);
+        }
+        else
+        {
+            offset_ = container.values[0];
+        }
+    }
+
+    // Move to the next entity.
+    void Next()
+    {
+        auto& container = set_->containers_[container_];
+
+        switch (container.type)
+        {
+            case ContainerType::kArray:
+                if (++position_ < container.values.size())
+                {
+                    offset_ = container.values[position_];
+                    return;
+                }
+                break;
+            case ContainerType::kBitmap:
+            {
+                // Bits of the current word above the current offset.
+                auto bits = offset_ % 64 == 63 ? 0 : container.bits[position_] & (~uint64_t(0) << (offset_ % 64 + 1));
+                while (!bits && ++position_ < kBitmapWords) { bits = container.bits[position_]; }
+                if (bits)
+                {
+                    offset_ = position_ * 64 + CountTrailingZeros(bits);
+                    return;
+                }
+                break;
+            }
+            case ContainerType::kRun:
+                if (offset_ < uint32_t(container.values[position_]) + container.values[position_ + 1])
+                {
+                    ++offset_;
+                    return;
+                }
+                position_ += 2;
+                if (position_ < container.values.size())
+                {
+                    offset_ = container.values[position_];
+                    return;
+                }
+                break;
+        }
+
+        ++container_;
+        Seek();
+    }
+
+    const CompressedEntitySet* set_;
+    // Current container, containers_.size() at the end.
+    size_t container_;
+    // Array index, bitmap word or run pair of the current entity.
+    uint32_t position_ = 0;
+    // Offset of the current entity within its block.
+    uint32_t offset_ = 0;
+};
+
+/**
+ * @brief Builds a compressed set from ascending entity indices.
+ *
+ * Indices of a block are collected into a bitmap, which is stored in the smallest container once
+ * the block is complete.
+ **/
+class CompressedEntitySet::Builder
+{
+public:
+    // The set and the scratch bitmap are allocated from resource.
+    Builder(const std::pmr::vector<EntityGeneration>& generations, std::pmr::memory_resource* resource)
+        : set_(generations, resource), bits_(kBitmapWords, 0, resource)
+    {
+    }
+
+    // Add an index greater than any index added before.
+    void Append(EntityIndex index)
+    {
+        auto key = index >> kBlockBits;
+        if (key != key_)
+        {
+            Flush();
+            key_ = key;
+        }
+
+        bits_[(index & (kBlockSize - 1)) / 64] |= uint64_t(1) << (index % 64);
+    }
+
+    // Finish building and return the set.
+    CompressedEntitySet Build()
+    {
+        Flush();
+        return std::move(set_);
+    }
+
+private:
+    // Store collected block.
+    void Flush()
+    {
+        Container container(set_.containers_.get_allocator());
+        container.key = key_;
+
+        if (FromBits(container, bits_.data()))
+        {
+            set_.size_ += container.size;
+            set_.containers_.push_back(std::move(container));
+            std::fill(bits_.begin(), bits_.end(), 0);
+        }
+    }
+
+    // Set being built.
+    CompressedEntitySet set_;
+    // Bits of the current block.
+    std::pmr::vector<uint64_t> bits_;
+    // Key of the current block.
+    uint32_t key_ = 0;
+};
+
+inline CompressedEntitySet::Iterator CompressedEntitySet::begin() const
+{
+    return Iterator(this, 0);
+}
+
+inline CompressedEntitySet::Iterator CompressedEntitySet::end() const
+{
+    return Iterator(this, containers_.size());
+}
+
+inline bool CompressedEntitySet::Contains(Entity entity) const
+{
+    auto index  = GetEntityIndex(entity);
+    auto key    = index >> kBlockBits;
+    auto offset = static_cast<uint16_t>(index & (kBlockSize - 1));
+
+    auto container = std::lower_bound(
+        containers_.cbegin(), containers_.cend(), key, [](const Container& c, uint32_t k) { return c.key < k; });
+
+    // Handles past the generation table can share a block with members, they are never alive.
+    if (container == containers_.cend() || container->key != key || index >= generations_->size() ||
+        (*generations_)[index] != GetEntityGeneration(entity))
+    {
+        return false;
+    }
+
+    switch (container->type)
+    {
+        case ContainerType::kArray:
+            return std::binary_search(container->values.cbegin(), container->values.cend(), offset);
+        case ContainerType::kBitmap:
+            return (container->bits[offset / 64] >> (offset % 64)) & 1;
+        case ContainerType::kRun:
+            for (size_t i = 0; i < container->values.size() && container->values[i] <= offset; i += 2)
+            {
+                if (offset - container->values[i] <= container->values[i + 1])
+                {
+                    return true;
+                }
+            }
+            return false;
+    }
+
+    return false;
+}
+
+template <typename F>
+inline void CompressedEntitySet::ForEachOffset(const Container& container, F&& f)
+{
+    switch (container.type)
+    {
+        case ContainerType::kArray:
+            for (auto offset : container.values) { f(uint32_t(offset)); }
+            break;
+        case ContainerType::kBitmap:
+            for (uint32_t word = 0; word < kBitmapWords; ++word)
+            {
+                for (auto bits = container.bits[word]; bits; bits &= bits - 1)
+                {
+                    f(word * 64 + CountTrailingZeros(bits));
+                }
+            }
+            break;
+        case ContainerType::kRun:
+            for (size_t i = 0; i < container.values.size(); i += 2)
+            {
+                for (uint32_t offset = container.values[i]; offset <= uint32_t(container.values[i]) + container.values[i + 1];
+                     ++offset)
+                {
+                    f(offset);
+                }
+            }
+            break;
+    }
+}
+
+template <typename F>
+inline void CompressedEntitySet::ForEach(F&& f) const
+{
+    auto& generations = *generations_;
+
+    for (auto& container : containers_)
+    {
+        auto base = container.key << kBlockBits;
+        ForEachOffset(container, [&f, &generations, base](uint32_t offset) {
+            f(MakeEntity(base | offset, generations[base | offset]));
+        });
+    }
+}
+
+template <typename F>
+inline void CompressedEntitySet::ForEachRun(const uint64_t* bits, F&& f)
+{
+    uint32_t word = 0;
+    uint64_t w    = bits[0];
+
+    for (;;)
+    {
+        // Find the first set bit.
+        while (!w)
+        {
+            if (++word == kBitmapWords)
+            {
+                return;
+            }
+            w = bits[word];
+        }
+
+        auto begin = word * 64 + CountTrailingZeros(w);
+
+        // Fill the bits below the run and find the first clear bit.
+        w |= w - 1;
+        while (w == ~uint64_t(0))
+        {
+            if (++word == kBitmapWords)
+            {
+                f(begin, kBlockSize);
+                return;
+            }
+            w = bits[word];
+        }
+
+        f(begin, word * 64 + CountTrailingZeros(~w));
+
+        // Clear the run.
+        w &= w + 1;
+    }
+}
+
+inline void CompressedEntitySet::ExpandBits(const Container& container, uint64_t* bits)
+{
+    std::fill(bits, bits + kBitmapWords, 0);
+
+    if (container.type == ContainerType::kBitmap)
+    {
+        std::copy(container.bits.cbegin(), container.bits.cend(), bits);
+        return;
+    }
+
+    if (container.type == ContainerType::kArray)
+    {
+        for (auto offset : container.values) { bits[offset / 64] |= uint64_t(1) << (offset % 64); }
+        return;
+    }
+
+    // Runs are filled a word at a time.
+    for (size_t i = 0; i < container.values.size(); i += 2)
+    {
+        uint32_t begin = container.values[i];
+        uint32_t end   = begin + container.values[i + 1] + 1;
+
+        while (begin < end)
+        {
+            auto count = std::min(64 - begin % 64, end - begin);
+            auto mask  = count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1) << (begin % 64);
+            bits[begin / 64] |= mask;
+            begin += count;
+        }
+    }
+}
+
+inline bool CompressedEntitySet::FromBits(Container& container, const uint64_t* bits)
+{
+    uint32_t size = 0;
+    for (uint32_t word = 0; word < kBitmapWords; ++word) { size += PopCount(bits[word]); }
+
+    if (!size)
+    {
+        return false;
+    }
+
+    container.type = ContainerType::kBitmap;
+    container.size = size;
+    container.values.clear();
+    container.bits.assign(bits, bits + kBitmapWords);
+    Optimize(container);
+    return true;
+}
+
+inline void CompressedEntitySet::Optimize(Container& container)
+{
+    // A run starts at every entity whose predecessor is not in the block.
+    uint32_t num_runs = 0;
+    switch (container.type)
+    {
+        case ContainerType::kArray:
+            for (size_t i = 0; i < container.values.size(); ++i)
+            {
+                num_runs += i == 0 || container.values[i] != container.values[i - 1] + 1;
+            }
+            break;
+        case ContainerType::kBitmap:
+            for (uint32_t word = 0; word < kBitmapWords; ++word)
+            {
+                auto carry = word ? container.bits[word - 1] >> 63 : 0;
+                num_runs += PopCount(container.bits[word] & ~((container.bits[word] << 1) | carry));
+            }
+            break;
+        case ContainerType::kRun:
+            num_runs = static_cast<uint32_t>(container.values.size() / 2);
+            break;
+    }
+
+    // Sizes in 16-bit values.
+    auto array_size  = container.size;
+    auto bitmap_size = kBitmapWords * 4;
+    auto run_size    = num_runs * 2;
+
+    auto type = run_size < std::min(array_size, bitmap_size)
+                    ? ContainerType::kRun
+                    : (array_size <= kMaxArraySize ? ContainerType::kArray : ContainerType::kBitmap);
+
+    if (type == container.type)
+    {
+        return;
+    }
+
+    decltype(container.values) values(container.values.get_allocator());
+    decltype(container.bits)   bits(container.bits.get_allocator());
+
+    switch (type)
+    {
+        case ContainerType::kArray:
+            values.reserve(array_size);
+            ForEachOffset(container, [&values](uint32_t offset) { values.push_back(static_cast<uint16_t>(offset)); });
+            break;
+        case ContainerType::kBitmap:
+            bits.resize(kBitmapWords);
+            ExpandBits(container, bits.data());
+            break;
+        case ContainerType::kRun:
+        {
+            const uint64_t* source = container.bits.data();
+            if (container.type == ContainerType::kArray)
+            {
+                bits.resize(kBitmapWords);
+                ExpandBits(container, bits.data());
+                source = bits.data();
+            }
+
+            values.reserve(run_size);
+            ForEachRun(source, [&values](uint32_t begin, uint32_t end) {
+                values.push_back(static_cast<uint16_t>(begin));
+                values.push_back(static_cast<uint16_t>(end - begin - 1));
+            });
+            bits.clear();
+            break;
+        }
+    }
+
+    container.type   = type;
+    container.values = std::move(values);
+    container.bits   = std::move(bits);
+}
+
+inline bool CompressedEntitySet::Combine(const Container& lhs,
+                                         const Container& rhs,
+                                         Operation        operation,
+                                         Container&       result)
+{
+    // Arrays are merged directly unless the union is too large for an array.
+    if (lhs.type == ContainerType::kArray && rhs.type == ContainerType::kArray &&
+        (operation != Operation::kUnion || lhs.size + rhs.size <= kMaxArraySize))
+    {
+        auto& a   = lhs.values;
+        auto& b   = rhs.values;
+        auto  out = std::back_inserter(result.values);
+
+        switch (operation)
+        {
+            case Operation::kIntersection:
+                std::set_intersection(a.cbegin(), a.cend(), b.cbegin(), b.cend(), out);
+                break;
+            case Operation::kUnion:
+                std::set_union(a.cbegin(), a.cend(), b.cbegin(), b.cend(), out);
+                break;
+            case Operation::kDifference:
+                std::set_difference(a.cbegin(), a.cend(), b.cbegin(), b.cend(), out);
+                break;
+        }
+
+        result.type = ContainerType::kArray;
+        result.size = static_cast<uint32_t>(result.values.size());
+        if (result.size)
+        {
+            Optimize(result);
+        }
+        return result.size != 0;
+    }
+
+    // Other containers are combined as bitmaps.
+    decltype(result.bits) lhs_bits(kBitmapWords, 0, result.bits.get_allocator());
+    decltype(result.bits) rhs_bits(kBitmapWords, 0, result.bits.get_allocator());
+    ExpandBits(lhs, lhs_bits.data());
+    ExpandBits(rhs, rhs_bits.data());
+
+    for (uint32_t word = 0; word < kBitmapWords; ++word)
+    {
+        switch (operation)
+        {
+            case Operation::kIntersection:
+                lhs_bits[word] &= rhs_bits[word];
+                break;
+            case Operation::kUnion:
+                lhs_bits[word] |= rhs_bits[word];
+                break;
+            case Operation::kDifference:
+                lhs_bits[word] &= ~rhs_bits[word];
+                break;
+        }
+    }
+
+    return FromBits(result, lhs_bits.data());
+}
+
+inline CompressedEntitySet CompressedEntitySet::Combine(const CompressedEntitySet& rhs, Operation operation) const
+{
+    CompressedEntitySet result(*generations_, containers_.get_allocator().resource());
+
+    // Blocks present in one of the sets only are kept as they are or dropped.
+    auto keep_lhs = operation != Operation::kIntersection;
+    auto keep_rhs = operation == Operation::kUnion;
+
+    auto append = [&result](auto&& container) {
+        result.size_ += container.size;
+        result.containers_.push_back(std::forward<decltype(container)>(container));
+    };
+
+    size_t i = 0, j = 0;
+    while (i < containers_.size() || j < rhs.containers_.size())
+    {
+        if (j == rhs.containers_.size() || (i < containers_.size() && containers_[i].key < rhs.containers_[j].key))
+        {
+            if (keep_lhs)
+            {
+                append(containers_[i]);
+            }
+            ++i;
+        }
+        else if (i == containers_.size() || rhs.containers_[j].key < containers_[i].key)
+        {
+            if (keep_rhs)
+            {
+                append(rhs.containers_[j]);
+            }
+            ++j;
+        }
+        else
+        {
+            Container container(result.containers_.get_allocator());
+            container.key = containers_[i].key;
+
+            if (Combine(containers_[i], rhs.containers_[j], operation, container))
+            {
+                append(std::move(container));
+            }
+
+            ++i;
+            ++j;
+        }
+    }
+
+    return result;
+}
+
+inline CompressedEntitySet CompressedEntitySet::Intersection(const CompressedEntitySet& rhs) const
+{
+    return Combine(rhs, Operation::kIntersection);
+}
+
+inline CompressedEntitySet CompressedEntitySet::Union(const CompressedEntitySet& rhs) const
+{
+    return Combine(rhs, Operation::kUnion);
+}
+
+inline CompressedEntitySet CompressedEntitySet::Difference(const CompressedEntitySet& rhs) const
+{
+    return Combine(rhs, Operation::kDifference);
+}
+
+inline EntitySet CompressedEntitySet::Decompress() const
+{
+    EntitySet::EntityStorage entities(containers_.get_allocator());
+    entities.reserve(size_);
+    ForEach([&entities](Entity entity) { entities.push_back(entity); });
+    return EntitySet(std::move(entities), true);
+}
+
+inline size_t CompressedEntitySet::memory_usage() const
+{
+    size_t bytes = containers_.capacity() * sizeof(Container);
+    for (auto& container : containers_)
+    {
+        bytes += container.values.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+}  // namespace yecs
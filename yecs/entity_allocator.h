@@ -0,0 +1,322 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "yecs/common.h"
+
+namespace yecs
+{
+/**
+ * @brief Order in which indices of destroyed entities are handed out again.
+ *
+ * kLifo reuses the most recently destroyed index first, keeping hot slots (and their components) cache resident.
+ * kFifo reuses the least recently destroyed index first, delaying reuse of any particular slot as long as possible.
+ *
+ * The policy orders indices destroyed one by one. Indices destroyed in batches are kept as sorted ranges
+ * and are reused only once there are no single indices left, highest index first, whatever the policy is.
+ **/
+enum class EntityReusePolicy
+{
+    kLifo,
+    kFifo
+};
+
+/**
+ * @brief O(1) entity index allocator.
+ *
+ * New indices are taken from the free list of destroyed entities first, if it is empty fresh indices are
+ * generated sequentially. Runs of indices destroyed at once are kept in a separate list of ranges, sorted
+ * and coalesced, so bulk creation can reuse them too. A bulk allocation which does not fit any range moves
+ * single indices over to the ranges, so they lose their reuse order. Generations are tracked by World:
+ * a reused range can mix generations of its slots.
+ **/
+class EntityAllocator
+{
+public:
+    explicit EntityAllocator(EntityReusePolicy          policy   = EntityReusePolicy::kLifo,
+                             std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : policy_(policy), free_(resource), free_ranges_(resource)
+    {
+    }
+
+    // Allocate an entity index.
+    EntityIndex Allocate();
+
+    // Allocate an index of a destroyed entity, returns std::nullopt if there are none. Single indices are
+    // taken according to the reuse policy, then ranges are split from the top.
+    std::optional<EntityIndex> AllocateFreed();
+
+    // Allocate count consecutive entity indices, returns the first one. The lowest freed range of at least
+    // count indices is reused if there is one, otherwise fresh indices are reserved.
+    EntityIndex Allocate(size_t count);
+
+    // Reserve a fresh entity index bypassing the free list. Unlike Allocate this is safe to call
+    // concurrently with other Reserve and Allocate calls.
+    EntityIndex Reserve();
+
+    // Reserve count consecutive fresh entity indices bypassing the free list, returns the first one.
+    // Safe to call concurrently with other Reserve and Allocate calls.
+    EntityIndex Reserve(size_t count);
+
+    // Return an entity index to the free list.
+    void Free(EntityIndex index) { free_.push_back(index); }
+
+    // Return count consecutive entity indices starting at first to the range list.
+    void Free(EntityIndex first, size_t count);
+
+    // Return a batch of ascending entity indices to the range list, consecutive indices are coalesced.
+    void Free(const EntityIndex* indices, size_t count);
+
+    // Number of indices ever generated (all allocated indices are < than this number).
+    size_t capacity() const { return next_.load(std::memory_order_relaxed); }
+
+    // Forget all allocated indices.
+    void Reset();
+
+private:
+    // Run of destroyed indices [first, first + size).
+    struct FreeRange
+    {
+        EntityIndex first;
+        size_t      size;
+    };
+
+    // Batches of more runs are merged with the range list instead of being inserted one by one.
+    static constexpr size_t kMaxInsertedRuns = 64;
+
+    // Find the lowest range of at least count indices.
+    std::pmr::vector<FreeRange>::iterator FindRange(size_t count);
+
+    // Return ascending entity indices to the range list, consecutive indices are coalesced.
+    template <typename It>
+    void FreeSorted(It begin, It end);
+
+    // Reuse policy.
+    EntityReusePolicy policy_;
+    // Destroyed indices available for reuse.
+    std::pmr::deque<EntityIndex> free_;
+    // Runs of destroyed indices available for reuse, sorted by first index and never adjacent.
+    std::pmr::vector<FreeRange> free_ranges_;
+    // Next fresh index.
+    std::atomic<EntityIndex> next_{0};
+};
+
+inline EntityIndex EntityAllocator::Allocate()
+{
+    auto index = AllocateFreed();
+    return index ? *index : Reserve();
+}
+
+inline std::optional<EntityIndex> EntityAllocator::AllocateFreed()
+{
+    if (free_.empty())
+    {
+        // Split the highest freed range, so a drained range is popped off the back in O(1).
+        if (free_ranges_.empty())
+        {
+            return std::nullopt;
+        }
+
+        auto& range = free_ranges_.back();
+        auto  index = range.first + static_cast<EntityIndex>(--range.size);
+        if (range.size == 0)
+        {
+            free_ranges_.pop_back();
+        }
+        return index;
+    }
+
+    EntityIndex index = 0;
+
+    if (policy_ == EntityReusePolicy::kLifo)
+    {
+        index = free_.back();
+        free_.pop_back();
+    }
+    else
+    {
+        index = free_.front();
+        free_.pop_front();
+    }
+
+    return index;
+}
+
+inline EntityIndex EntityAllocator::Allocate(size_t count)
+{
+    auto it = FindRange(count);
+
+    // Single indices might fill the gaps between ranges, move them over and try again.
+    if (it == free_ranges_.end() && !free_.empty())
+    {
+        std::sort(free_.begin(), free_.end());
+        FreeSorted(free_.cbegin(), free_.cend());
+        free_.clear();
+        it = FindRange(count);
+    }
+
+    if (it == free_ranges_.end())
+    {
+        return Reserve(count);
+    }
+
+    auto first = it->first;
+    it->first += static_cast<EntityIndex>(count);
+    it->size -= count;
+    if (it->size == 0)
+    {
+        free_ranges_.erase(it);
+    }
+
+    return first;
+}
+
+inline void EntityAllocator::Free(EntityIndex first, size_t count)
+{
+    auto end = static_cast<size_t>(first) + count;
+    auto it  = std::lower_bound(free_ranges_.begin(), free_ranges_.end(), first,
+                               [](const FreeRange& range, EntityIndex index) { return range.first < index; });
+
+    // Merge with the preceding and the following range if they are adjacent.
+    auto prev_adjacent = it != free_ranges_.begin() && std::prev(it)->first + std::prev(it)->size == first;
+    auto next_adjacent = it != free_ranges_.end() && it->first == end;
+
+    if (prev_adjacent && next_adjacent)
+    {
+        std::prev(it)->size += count + it->size;
+        free_ranges_.erase(it);
+    }
+    else if (prev_adjacent)
+    {
+        std::prev(it)->size += count;
+    }
+    else if (next_adjacent)
+    {
+        it->first = first;
+        it->size += count;
+    }
+    else
+    {
+        free_ranges_.insert(it, FreeRange{first, count});
+    }
+}
+
+inline void EntityAllocator::Free(const EntityIndex* indices, size_t count)
+{
+    FreeSorted(indices, indices + count);
+}
+
+template <typename It>
+inline void EntityAllocator::FreeSorted(It begin, It end)
+{
+    std::pmr::vector<FreeRange> runs(free_ranges_.get_allocator());
+    for (auto it = begin; it != end;)
+    {
+        auto first = *it;
+        auto size  = size_t(1);
+        while (++it != end && *it == first + static_cast<EntityIndex>(size)) { ++size; }
+        runs.push_back(FreeRange{first, size});
+    }
+
+    // Appends a range coalescing it with the last one.
+    auto append = [this](const FreeRange& range) {
+        if (!free_ranges_.empty() && free_ranges_.back().first + free_ranges_.back().size == range.first)
+        {
+            free_ranges_.back().size += range.size;
+        }
+        else
+        {
+            free_ranges_.push_back(range);
+        }
+    };
+
+    // Runs past the last range are appended, a few runs are inserted one by one,
+    // otherwise runs are merged with existing ranges in one pass.
+    if (runs.empty())
+    {
+        return;
+    }
+    else if (free_ranges_.empty() || runs.front().first > free_ranges_.back().first)
+    {
+        free_ranges_.reserve(free_ranges_.size() + runs.size());
+        for (auto& run : runs) { append(run); }
+    }
+    else if (runs.size() < kMaxInsertedRuns)
+    {
+        for (auto& run : runs) { Free(run.first, run.size); }
+    }
+    else
+    {
+        std::pmr::vector<FreeRange> merged(free_ranges_.get_allocator());
+        merged.reserve(free_ranges_.size() + runs.size());
+        std::merge(free_ranges_.cbegin(), free_ranges_.cend(), runs.cbegin(), runs.cend(), std::back_inserter(merged),
+                   [](const FreeRange& lhs, const FreeRange& rhs) { return lhs.first < rhs.first; });
+
+        free_ranges_.clear();
+        for (auto& range : merged) { append(range); }
+    }
+}
+
+inline std::pmr::vector<EntityAllocator::FreeRange>::iterator EntityAllocator::FindRange(size_t count)
+{
+    return std::find_if(free_ranges_.begin(), free_ranges_.end(),
+                        [count](const FreeRange& range) { return range.size >= count; });
+}
+
+inline EntityIndex EntityAllocator::Reserve()
+{
+    return Reserve(1);
+}
+
+inline EntityIndex EntityAllocator::Reserve(size_t count)
+{
+    auto index = next_.load(std::memory_order_relaxed);
+
+    do
+    {
+        if (index > kMaxEntityIndex || count > size_t(kMaxEntityIndex - index) + 1)
+        {
+            throw std::runtime_error("EntityAllocator: out of entity indices");
+        }
+    } while (!next_.compare_exchange_weak(index, index + static_cast<EntityIndex>(count), std::memory_order_relaxed));
+
+    return index;
+}
+
+inline void EntityAllocator::Reset()
+{
+    free_.clear();
+    free_ranges_.clear();
+    next_ = 0;
+}
+}  // namespace yecs
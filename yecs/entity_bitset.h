@@ -0,0 +1,206 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <memory_resource>
+#include <vector>
+
+#include "yecs/common.h"
+
+namespace yecs
+{
+/** @brief Two-level bitset of entity indices.
+ *
+ * Bits are stored in 64-bit words, a summary level keeps one bit per word telling if the word has any bit set.
+ * Set bits are enumerated word by word with CountTrailingZeros, empty 64-entity blocks are skipped without
+ * being touched and empty ranges of 4096 entities are skipped by a single summary word test.
+ **/
+class EntityBitset
+{
+public:
+    // Number of bits per word.
+    static constexpr size_t kWordBits = 64;
+
+    explicit EntityBitset(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : words_(resource), summary_(resource)
+    {
+    }
+
+    // Number of bits.
+    size_t size() const { return size_; }
+
+    // Number of set bits.
+    size_t count() const { return count_; }
+
+    // Grow or shrink the bitset, new bits are cleared.
+    void resize(size_t size);
+
+    // Clear and release all the bits.
+    void clear();
+
+    // Test a bit, index should be < size().
+    bool test(EntityIndex index) const { return (words_[index / kWordBits] >> (index % kWordBits)) & 1; }
+
+    // Set a bit, index should be < size().
+    void set(EntityIndex index);
+
+    // Clear a bit, index should be < size().
+    void reset(EntityIndex index);
+
+    // Call f(EntityIndex) for every set bit in increasing order.
+    template <typename F>
+    void ForEach(F&& f) const;
+
+    // Call f(size_t word_index, uint64_t word) for every non-zero word in increasing order.
+    template <typename F>
+    void ForEachWord(F&& f) const;
+
+    // Bit words.
+    const std::pmr::vector<uint64_t>& words() const { return words_; }
+
+private:
+    // Bits.
+    std::pmr::vector<uint64_t> words_;
+    // Bit i of summary word j is set if words_[j * kWordBits + i] != 0.
+    std::pmr::vector<uint64_t> summary_;
+    // Number of bits.
+    size_t size_ = 0;
+    // Number of set bits.
+    size_t count_ = 0;
+};
+
+namespace detail
+{
+/**
+ * @brief Compact a packed array after a batch of removals.
+ *
+ * Vacated positions below the new size are filled with survivors from the tail, so every survivor moves at most
+ * once. move(from, to) is called for each relocated element, the caller truncates its arrays to the returned size.
+ *
+ * @param size Size of the array before removal.
+ * @param removed Bit per position of removed elements.
+ * @param move Function relocating an element.
+ *
+ * @return Size of the array after removal.
+ **/
+template <typename F>
+size_t CompactRemoved(size_t size, const EntityBitset& removed, F&& move);
+}  // namespace detail
+
+inline void EntityBitset::resize(size_t size)
+{
+    auto num_words = (size + kWordBits - 1) / kWordBits;
+
+    // Drop bits past the new size when shrinking.
+    for (auto index = size; index < size_; ++index)
+    {
+        if (test(static_cast<EntityIndex>(index)))
+        {
+            reset(static_cast<EntityIndex>(index));
+        }
+    }
+
+    words_.resize(num_words, 0);
+    summary_.resize((num_words + kWordBits - 1) / kWordBits, 0);
+    size_ = size;
+}
+
+inline void EntityBitset::clear()
+{
+    words_.clear();
+    summary_.clear();
+    size_  = 0;
+    count_ = 0;
+}
+
+inline void EntityBitset::set(EntityIndex index)
+{
+    auto  word = index / kWordBits;
+    auto  mask = uint64_t(1) << (index % kWordBits);
+    auto& bits = words_[word];
+
+    if (!(bits & mask))
+    {
+        bits |= mask;
+        summary_[word / kWordBits] |= uint64_t(1) << (word % kWordBits);
+        ++count_;
+    }
+}
+
+inline void EntityBitset::reset(EntityIndex index)
+{
+    auto  word = index / kWordBits;
+    auto  mask = uint64_t(1) << (index % kWordBits);
+    auto& bits = words_[word];
+
+    if (bits & mask)
+    {
+        bits &= ~mask;
+        if (!bits)
+        {
+            summary_[word / kWordBits] &= ~(uint64_t(1) << (word % kWordBits));
+        }
+        --count_;
+    }
+}
+
+template <typename F>
+inline void EntityBitset::ForEach(F&& f) const
+{
+    ForEachWord([&f](size_t word, uint64_t bits) {
+        for (; bits; bits &= bits - 1) { f(static_cast<EntityIndex>(word * kWordBits + CountTrailingZeros(bits))); }
+    });
+}
+
+template <typename F>
+inline void EntityBitset::ForEachWord(F&& f) const
+{
+    for (size_t i = 0; i < summary_.size(); ++i)
+    {
+        for (auto summary = summary_[i]; summary; summary &= summary - 1)
+        {
+            auto word = i * kWordBits + CountTrailingZeros(summary);
+            f(word, words_[word]);
+        }
+    }
+}
+
+template <typename F>
+inline size_t detail::CompactRemoved(size_t size, const EntityBitset& removed, F&& move)
+{
+    auto new_size = size - removed.count();
+    auto tail     = new_size;
+
+    removed.ForEach([new_size, &tail, &removed, &move](EntityIndex hole) {
+        if (hole < new_size)
+        {
+            // Removed elements of the tail are not relocated.
+            while (removed.test(static_cast<EntityIndex>(tail))) { ++tail; }
+            move(tail++, hole);
+        }
+    });
+
+    return new_size;
+}
+}  // namespace yecs
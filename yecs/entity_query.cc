@@ -4,18 +4,25 @@
 
 namespace yecs
 {
-EntityQuery::EntityQuery(World& world) noexcept : world_(world) {}
+EntityQuery::EntityQuery(World& world) noexcept : EntityQuery(world, world.GetMemoryResource()) {}
+
+EntityQuery::EntityQuery(World& world, std::pmr::memory_resource* resource) noexcept
+    : world_(world), resource_(resource)
+{
+}
+
+EntityQuery EntityQuery::Using(std::pmr::memory_resource* resource) const noexcept
+{
+    return EntityQuery(world_, resource);
+}
 
 EntitySet EntityQuery::operator()() const
 {
-    EntitySet::EntityStorage entities;
-    for (uint32_t i = 0; i < world_.entities_.size(); ++i)
-    {
-        if (world_.entities_[i])
-        {
-            entities.push_back(i);
-        }
-    }
-    return EntitySet(std::move(entities));
+    EntitySet::EntityStorage entities(resource_);
+    entities.reserve(world_.entities_.count());
+    world_.entities_.ForEach([this, &entities](EntityIndex i) {
+        entities.push_back(MakeEntity(i, world_.generations_[i]));
+    });
+    return EntitySet(std::move(entities), true);
 }
 }  // namespace yecs
\ No newline at end of file
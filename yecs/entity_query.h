@@ -23,18 +23,27 @@ SOFTWARE.
 ****************************************************************************/
 #pragma once
 
+#include <memory_resource>
+#include <tuple>
+#include <vector>
+
 #include "yecs/common.h"
+#include "yecs/compressed_entity_set.h"
 #include "yecs/entity_set.h"
+#include "yecs/query_terms.h"
 
 namespace yecs
 {
+class CachedQuery;
+class EntityBitset;
 class World;
 
 /**
  * @brief An interface providing entity querying functionality to System subclasses.
  *
  * EntityQuery's single purpose is to serve as a medium between World and System subclasses,
- * guarding world from unattended access.
+ * guarding world from unattended access. Entity sets are allocated from the world memory resource,
+ * Using binds a query to another resource, e.g. the frame arena of the calling thread.
  **/
 class EntityQuery
 {
@@ -45,6 +54,19 @@ public:
     EntityQuery(const EntityQuery&) = delete;
     EntityQuery operator=(const EntityQuery&) = delete;
 
+    /**
+     * @brief Return a query allocating its results from a given memory resource.
+     *
+     * Systems running every frame can query into the frame arena of the calling thread and avoid
+     * touching the global heap: entity_query.Using(&access.FrameArena()).WithComponents<Position>().
+     * Results share the lifetime of the resource, sets allocated from a frame arena are only valid
+     * until the next World::Run.
+     *
+     * @param resource Memory resource for entity sets, should outlive them.
+     * @return Query bound to the resource.
+     **/
+    EntityQuery Using(std::pmr::memory_resource* resource) const noexcept;
+
     /**
      * @brief Return an EntitySet containing all entities in the world.
      *
@@ -54,8 +76,145 @@ public:
      **/
     EntitySet operator()() const;
 
+    /**
+     * @brief Return an EntitySet containing entities having all of the given components.
+     *
+     * Entities are matched by testing their component masks, tag components are intersected with
+     * live entities 64 entities at a time.
+     *
+     * @tparam ComponentTs Component types, should be registered in the world.
+     * @return EntitySet with matching entities.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... ComponentTs>
+    EntitySet WithComponents() const;
+
+    /**
+     * @brief Return a predicate testing if an entity has all of the given components.
+     *
+     * Intended for EntitySet filtering: entity_query().Filter(entity_query.HasComponents<Position, Velocity>()).
+     *
+     * @tparam ComponentTs Component types, should be registered in the world.
+     * @return Predicate taking an Entity.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... ComponentTs>
+    auto HasComponents() const;
+
+    /**
+     * @brief Return an EntitySet containing entities matching query terms.
+     *
+     * Terms are With<ComponentTs...> (entity has all of the components), Without<ComponentTs...> (entity has
+     * none of them) and Optional<ComponentTs...> (not used for matching). Terms are evaluated against component
+     * masks without probing storages, tags are intersected 64 entities at a time:
+     * entity_query.Match<With<Position, Velocity>, Without<Frozen>>().
+     *
+     * @tparam TermTs Query terms, component types should be registered in the world.
+     * @return EntitySet with matching entities.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... TermTs>
+    EntitySet Match() const;
+
+    /**
+     * @brief Return a CompressedEntitySet containing entities matching query terms.
+     *
+     * Works like Match, but entities are stored in compressed blocks of 65536 (arrays, bitmaps or runs,
+     * whichever is the smallest), which is preferable for huge worlds. The set refers to world generations
+     * and should not be kept past structural changes.
+     *
+     * @tparam TermTs Query terms, component types should be registered in the world.
+     * @return CompressedEntitySet with matching entities.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... TermTs>
+    CompressedEntitySet MatchCompressed() const;
+
+    /**
+     * @brief Call a function for every entity matching query terms.
+     *
+     * Entities are matched like in Match, f is called as f(Entity, WithTs&..., OptionalTs*...): components
+     * listed in With are passed by reference, components listed in Optional by pointer, which is nullptr if
+     * entity does not have the component. Const-qualified components are passed read-only:
+     * entity_query.ForEach<With<Position, const Velocity>, Without<Frozen>, Optional<const Mass>>(
+     *     [](Entity e, Position& pos, const Velocity& vel, const Mass* mass) { ... });
+     * Components should not be added or removed while iterating.
+     *
+     * @tparam TermTs Query terms, component types should be registered in the world.
+     * @param f Function to call.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... TermTs, typename F>
+    void ForEach(F&& f) const;
+
+    /**
+     * @brief Return a cached query over entities having all of the given components.
+     *
+     * The query is registered on first use and then kept up to date by World, so iterating it costs
+     * no matching work (see World::RegisterQuery). Systems running every frame over a stable set of
+     * entities should prefer it to WithComponents.
+     *
+     * @tparam ComponentTs Component types, should be registered in the world.
+     * @return Reference to the query.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... ComponentTs>
+    const CachedQuery& Cached() const;
+
+    /**
+     * @brief Return an EntitySet containing entities whose component has changed since a given tick.
+     *
+     * A component is changed when it is added, overwritten by a command buffer or marked changed
+     * (ComponentAccess::MarkChanged, ComponentAccess::Write(entity)). A system remembering the tick of
+     * its previous run (ComponentAccess::GetTick) gets every change made since then, changes made
+     * during that tick after the system has run are reported again.
+     *
+     * @tparam ComponentT Component type, should be registered in the world.
+     * @param since Changes stamped with this tick or later are reported.
+     * @return EntitySet with matching entities.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename ComponentT>
+    EntitySet Changed(Tick since) const;
+
+    // Same as Changed, but only reports components added since a given tick.
+    template <typename ComponentT>
+    EntitySet Added(Tick since) const;
+
 private:
+    EntityQuery(World& world, std::pmr::memory_resource* resource) noexcept;
+
+    // Entities having ComponentT component added (or changed if added is false) at since or later.
+    template <typename ComponentT>
+    EntitySet Stamped(Tick since, bool added) const;
+
+    // Bits of tag storages, allocated from the query resource.
+    using TagBits = std::pmr::vector<const EntityBitset*>;
+
+    // Append bits of a tag storage if ComponentT is stored as a tag.
+    template <typename ComponentT>
+    void AppendTagBits(TagBits& tag_bits) const;
+
+    // Call f(EntityIndex) for alive entities having all of the required and none of the excluded components.
+    // Bits of required and excluded tags are applied to whole words of the entity table first.
+    template <typename F>
+    void ForEachMatching(const ComponentMask& required,
+                         const ComponentMask& excluded,
+                         const TagBits&       required_tags,
+                         const TagBits&       excluded_tags,
+                         F&&                  f) const;
+
+    // Call f(EntityIndex) for alive entities matching component lists of query terms.
+    template <typename... WithTs, typename... WithoutTs, typename F>
+    void ForEachMatching(std::tuple<WithTs...>*, std::tuple<WithoutTs...>*, F&& f) const;
+
+    // ForEach implementation over component lists of query terms.
+    template <typename... WithTs, typename... WithoutTs, typename... OptionalTs, typename F>
+    void ForEach(std::tuple<WithTs...>*, std::tuple<WithoutTs...>*, std::tuple<OptionalTs...>*, F& f) const;
+
     // Reference to our world object.
     World& world_;
+    // Resource entity sets are allocated from.
+    std::pmr::memory_resource* resource_;
 };
 }  // namespace yecs
@@ -24,20 +24,38 @@ SOFTWARE.
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "yecs/common.h"
+#include "yecs/set_operations.h"
 
 namespace yecs
 {
+template <typename... StageTs>
+class EntityPipeline;
+
 /** @brief Represets a collection of entities and provides filtering operations.
  *
  * EntitySet is primarily designed to be used as a result of entity queries for
  * systems. EntitySet provides and API to filter entities based on binary predicate.
+ * Sets returned by EntityQuery are sorted in ascending entity order, which follows entity
+ * indices, filtering keeps the order. Sorted sets are intersected, united and subtracted in linear time.
+ * Filters and set operations allocate from the resource of the source set. Sets returned by EntityQuery
+ * allocate from the world resource, unless the query is bound to another one (EntityQuery::Using): sets
+ * allocated from a frame arena, and everything derived from them, are only valid until the next World::Run.
  **/
 class EntitySet
 {
 public:
-    using EntityStorage = std::vector<Entity>;
+    using EntityStorage = std::pmr::vector<Entity>;
 
     // Copies are forbidden.
     // TODO: do we need them?
@@ -46,7 +64,7 @@ public:
 
     EntitySet(EntitySet&& rhs);
 
-    // Filter a set of entities inplace.
+    // Filter a set of entities inplace, order of entities is kept.
     template <typename F>
     EntitySet& FilterInPlace(F&& f);
 
@@ -61,39 +79,455 @@ public:
     // Return entities.
     const EntityStorage& entities() const { return entities_; }
 
+    // True if entities are in ascending order.
+    bool sorted() const noexcept { return sorted_; }
+
+    // Sort entities in ascending order.
+    EntitySet& Sort();
+
+    /**
+     * @brief Set operations, the result is sorted.
+     *
+     * Sorted sets are merged in linear time (four entities at a time with SSE2), unsorted operands are
+     * sorted first.
+     **/
+    EntitySet Intersection(const EntitySet& rhs) const;
+    EntitySet Union(const EntitySet& rhs) const;
+    EntitySet Difference(const EntitySet& rhs) const;
+
+    // Lazy pipeline over entities of the set, set should outlive the pipeline.
+    EntityPipeline<> Lazy() const&;
+    // Lazy pipeline taking over entities of a temporary set.
+    EntityPipeline<> Lazy() &&;
+
 private:
     // Construct from L-value storage.
-    EntitySet(const EntityStorage& entities) : entities_(entities) {}
+    EntitySet(const EntityStorage& entities, bool sorted) : entities_(entities), sorted_(sorted) {}
     // Construct from temp storage (moving it in).
-    EntitySet(EntityStorage&& entities) : entities_(std::move(entities)) {}
+    EntitySet(EntityStorage&& entities, bool sorted) : entities_(std::move(entities)), sorted_(sorted) {}
+
+    // Run a merge of two sets, merge(a, na, b, nb, out) returns number of entities written to out.
+    template <typename F>
+    EntitySet Merge(const EntitySet& rhs, size_t capacity, F&& merge) const;
+
     // Entity storage.
     EntityStorage entities_;
+    // True if entities are in ascending order.
+    bool sorted_ = false;
 
+    friend class CompressedEntitySet;
     friend class EntityQuery;
+    template <typename... StageTs>
+    friend class EntityPipeline;
 };
 
-inline EntitySet::EntitySet(EntitySet&& rhs) : entities_(std::move(rhs.entities_)) {}
+inline EntitySet::EntitySet(EntitySet&& rhs) : entities_(std::move(rhs.entities_)), sorted_(rhs.sorted_) {}
 
 template <typename F>
 inline EntitySet& EntitySet::FilterInPlace(F&& f)
 {
-    auto new_end = std::partition(entities_.begin(), entities_.end(), std::forward<F>(f));
-    entities_.resize(std::distance(entities_.begin(), new_end));
+    auto new_end = std::remove_if(entities_.begin(), entities_.end(), [&f](Entity entity) { return !f(entity); });
+    entities_.erase(new_end, entities_.end());
     return *this;
 }
 
 template <typename F>
 inline EntitySet EntitySet::Filter(F&& f) &&
 {
-    auto new_end = std::partition(entities_.begin(), entities_.end(), std::forward<F>(f));
-    entities_.resize(std::distance(entities_.begin(), new_end));
-    return EntitySet(std::move(entities_));
+    FilterInPlace(std::forward<F>(f));
+    return EntitySet(std::move(entities_), sorted_);
 }
 
 template <typename F>
 inline EntitySet EntitySet::Filter(F&& f) const&
 {
-    auto new_end = std::partition(entities_.begin(), entities_.end(), std::forward<F>(f));
-    return EntitySet(EntityStorage(entities_.begin(), new_end));
+    EntityStorage entities(entities_.get_allocator());
+    std::copy_if(entities_.cbegin(), entities_.cend(), std::back_inserter(entities), std::forward<F>(f));
+    return EntitySet(std::move(entities), sorted_);
+}
+
+inline EntitySet& EntitySet::Sort()
+{
+    if (!sorted_)
+    {
+        std::sort(entities_.begin(), entities_.end());
+        sorted_ = true;
+    }
+    return *this;
+}
+
+template <typename F>
+inline EntitySet EntitySet::Merge(const EntitySet& rhs, size_t capacity, F&& merge) const
+{
+    // Unsorted operands are sorted into copies.
+    EntityStorage lhs_sorted(entities_.get_allocator());
+    EntityStorage rhs_sorted(entities_.get_allocator());
+
+    auto sorted = [](const EntitySet& set, EntityStorage& copy) -> const EntityStorage& {
+        if (set.sorted_)
+        {
+            return set.entities_;
+        }
+
+        copy = set.entities_;
+        std::sort(copy.begin(), copy.end());
+        return copy;
+    };
+
+    auto& a = sorted(*this, lhs_sorted);
+    auto& b = sorted(rhs, rhs_sorted);
+
+    EntityStorage entities(capacity, entities_.get_allocator());
+    entities.resize(merge(a.data(), a.size(), b.data(), b.size(), entities.data()));
+    return EntitySet(std::move(entities), true);
+}
+
+inline EntitySet EntitySet::Intersection(const EntitySet& rhs) const
+{
+    return Merge(rhs, std::min(entities_.size(), rhs.entities_.size()), detail::IntersectSorted);
+}
+
+inline EntitySet EntitySet::Union(const EntitySet& rhs) const
+{
+    return Merge(rhs, entities_.size() + rhs.entities_.size(), detail::UniteSorted);
+}
+
+inline EntitySet EntitySet::Difference(const EntitySet& rhs) const
+{
+    return Merge(rhs, entities_.size(), detail::SubtractSorted);
+}
+
+namespace detail
+{
+// Pipeline stage passing on values satisfying a predicate.
+template <typename F>
+struct FilterStage
+{
+    template <typename T>
+    using Output = T;
+
+    // Stages return false once the pipeline should stop.
+    template <typename T, typename NextF>
+    bool operator()(T&& value, NextF&& next)
+    {
+        return f(std::as_const(value)) ? next(std::forward<T>(value)) : true;
+    }
+
+    F f;
+};
+
+// Pipeline stage passing on results of a function.
+template <typename F>
+struct TransformStage
+{
+    template <typename T>
+    using Output = std::decay_t<std::invoke_result_t<F&, T>>;
+
+    template <typename T, typename NextF>
+    bool operator()(T&& value, NextF&& next)
+    {
+        return next(f(std::forward<T>(value)));
+    }
+
+    F f;
+};
+
+// Pipeline stage passing on first count values and stopping the pipeline.
+struct TakeStage
+{
+    template <typename T>
+    using Output = T;
+
+    template <typename T, typename NextF>
+    bool operator()(T&& value, NextF&& next)
+    {
+        if (taken == count)
+        {
+            return false;
+        }
+
+        ++taken;
+        return next(std::forward<T>(value)) && taken < count;
+    }
+
+    size_t count = 0;
+    size_t taken = 0;
+};
+
+template <typename StageT>
+struct IsTransformStage : std::false_type
+{
+};
+
+template <typename F>
+struct IsTransformStage<TransformStage<F>> : std::true_type
+{
+};
+
+// Type of values produced by a sequence of stages from T.
+template <typename T, typename... StageTs>
+struct PipelineOutput
+{
+    using Type = T;
+};
+
+template <typename T, typename StageT, typename... StageTs>
+struct PipelineOutput<T, StageT, StageTs...>
+{
+    using Type = typename PipelineOutput<typename StageT::template Output<T>, StageTs...>::Type;
+};
+}  // namespace detail
+
+/** @brief Lazy sequence of filters, transforms and takes over a range of entities.
+ *
+ * Stages are only recorded when chained and run fused in a single pass when the pipeline is consumed, no
+ * intermediate entity arrays are allocated:
+ * for (auto e : set.Lazy().Filter(is_visible).Take(100)) { ... }
+ * Pipeline can be consumed by range-for, by ForEach, in parallel by ParallelForEach (unless it has Take stages)
+ * or materialized with Collect. Pipeline is consumed from scratch every time, functions should be cheap to copy.
+ **/
+template <typename... StageTs>
+class EntityPipeline
+{
+public:
+    // Type of values produced by the pipeline.
+    using ValueType = typename detail::PipelineOutput<Entity, StageTs...>::Type;
+
+    // True if values depend on order of processing, such pipelines can not be processed in parallel.
+    static constexpr bool kOrdered = (std::is_same_v<StageTs, detail::TakeStage> || ...);
+    // True if values come out in source order, transforms can produce anything.
+    static constexpr bool kKeepsOrder = !(detail::IsTransformStage<StageTs>::value || ...);
+
+    class Iterator;
+
+    // Pipeline over [first, last), entities should outlive the pipeline. sorted tells if entities are in ascending order.
+    // Collect allocates entity sets from resource.
+    EntityPipeline(const Entity*              first,
+                   const Entity*              last,
+                   bool                       sorted   = false,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept
+        : first_(first), last_(last), sorted_(sorted), resource_(resource)
+    {
+    }
+
+    // Pipeline owning entities, the entities are kept in their memory resource.
+    explicit EntityPipeline(EntitySet::EntityStorage entities, bool sorted = false)
+        : owner_(std::allocate_shared<EntitySet::EntityStorage>(
+              std::pmr::polymorphic_allocator<EntitySet::EntityStorage>(entities.get_allocator()), std::move(entities)))
+        , first_(owner_->data())
+        , last_(owner_->data() + owner_->size())
+        , sorted_(sorted)
+        , resource_(owner_->get_allocator().resource())
+    {
+    }
+
+    // Keep values satisfying predicate f(const ValueType&).
+    template <typename F>
+    EntityPipeline<StageTs..., detail::FilterStage<std::decay_t<F>>> Filter(F&& f) const
+    {
+        return Append(detail::FilterStage<std::decay_t<F>>{std::forward<F>(f)});
+    }
+
+    // Replace values with results of f(ValueType).
+    template <typename F>
+    EntityPipeline<StageTs..., detail::TransformStage<std::decay_t<F>>> Transform(F&& f) const
+    {
+        return Append(detail::TransformStage<std::decay_t<F>>{std::forward<F>(f)});
+    }
+
+    // Keep first count values, entities past the last one taken are not visited.
+    EntityPipeline<StageTs..., detail::TakeStage> Take(size_t count) const
+    {
+        return Append(detail::TakeStage{count});
+    }
+
+    // Call f(ValueType) for every value.
+    template <typename F>
+    void ForEach(F&& f) const
+    {
+        ForEach(0, size_hint(), std::forward<F>(f));
+    }
+
+    /**
+     * @brief Call f(ValueType) for every value produced from source entities [begin, end).
+     *
+     * Allows to split processing into independent chunks, [0, size_hint()) covers all the entities.
+     **/
+    template <typename F>
+    void ForEach(size_t begin, size_t end, F&& f) const;
+
+    // Number of source entities.
+    size_t size_hint() const { return static_cast<size_t>(last_ - first_); }
+
+    /**
+     * @brief Run the pipeline and store the values.
+     *
+     * @return EntitySet if the pipeline produces entities, std::vector<ValueType> otherwise.
+     **/
+    auto Collect() const;
+
+    Iterator begin() const { return Iterator(first_, last_, stages_); }
+    Iterator end() const { return Iterator(last_, last_, stages_); }
+
+private:
+    template <typename... OtherStageTs>
+    friend class EntityPipeline;
+
+    EntityPipeline(std::shared_ptr<const EntitySet::EntityStorage> owner,
+                   const Entity*                                    first,
+                   const Entity*                                    last,
+                   bool                                             sorted,
+                   std::pmr::memory_resource*                       resource,
+                   std::tuple<StageTs...>                           stages)
+        : owner_(std::move(owner))
+        , first_(first)
+        , last_(last)
+        , sorted_(sorted)
+        , resource_(resource)
+        , stages_(std::move(stages))
+    {
+    }
+
+    // Pipeline with one more stage.
+    template <typename StageT>
+    EntityPipeline<StageTs..., StageT> Append(StageT stage) const
+    {
+        return EntityPipeline<StageTs..., StageT>(
+            owner_, first_, last_, sorted_, resource_, std::tuple_cat(stages_, std::make_tuple(std::move(stage))));
+    }
+
+    // Pass value through stages starting from I, call sink(ValueType) for the result.
+    // Returns false once the pipeline should stop.
+    template <size_t I, typename T, typename SinkF>
+    static bool Apply(std::tuple<StageTs...>& stages, T&& value, SinkF& sink)
+    {
+        if constexpr (I == sizeof...(StageTs))
+        {
+            sink(std::forward<T>(value));
+            return true;
+        }
+        else
+        {
+            return std::get<I>(stages)(std::forward<T>(value), [&stages, &sink](auto&& next) {
+                return Apply<I + 1>(stages, std::forward<decltype(next)>(next), sink);
+            });
+        }
+    }
+
+    // Storage of an owning pipeline.
+    std::shared_ptr<const EntitySet::EntityStorage> owner_;
+    // Source entities.
+    const Entity* first_ = nullptr;
+    const Entity* last_  = nullptr;
+    // True if source entities are in ascending order.
+    bool sorted_ = false;
+    // Resource for collected entity sets.
+    std::pmr::memory_resource* resource_ = nullptr;
+    // Stages in order of application.
+    std::tuple<StageTs...> stages_;
+};
+
+/**
+ * @brief Input iterator running the pipeline as it is advanced.
+ **/
+template <typename... StageTs>
+class EntityPipeline<StageTs...>::Iterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = ValueType;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const ValueType*;
+    using reference         = const ValueType&;
+
+    Iterator(const Entity* current, const Entity* last, std::tuple<StageTs...> stages)
+        : current_(current), last_(last), stages_(std::move(stages))
+    {
+        Advance();
+    }
+
+    reference operator*() const { return *value_; }
+    pointer   operator->() const { return &*value_; }
+
+    Iterator& operator++()
+    {
+        Advance();
+        return *this;
+    }
+
+    // Iterators are equal if both are exhausted or both stand after the same source entity.
+    bool operator==(const Iterator& rhs) const
+    {
+        return value_.has_value() == rhs.value_.has_value() && (!value_ || current_ == rhs.current_);
+    }
+    bool operator!=(const Iterator& rhs) const { return !(*this == rhs); }
+
+private:
+    // Run source entities through the stages until a value comes out or the pipeline stops.
+    void Advance()
+    {
+        value_.reset();
+
+        auto sink = [this](auto&& value) { value_.emplace(std::forward<decltype(value)>(value)); };
+        while (!value_ && current_ != last_)
+        {
+            if (!Apply<0>(stages_, *current_++, sink))
+            {
+                last_ = current_;
+            }
+        }
+    }
+
+    // Next source entity.
+    const Entity* current_;
+    const Entity* last_;
+    // Stage state of this pass.
+    std::tuple<StageTs...> stages_;
+    // Current value, empty once exhausted.
+    std::optional<ValueType> value_;
+};
+
+template <typename... StageTs>
+template <typename F>
+inline void EntityPipeline<StageTs...>::ForEach(size_t begin, size_t end, F&& f) const
+{
+    // Stages are copied, so every pass starts with fresh take counters.
+    auto stages = stages_;
+
+    for (auto entity = first_ + begin; entity != first_ + end; ++entity)
+    {
+        if (!Apply<0>(stages, *entity, f))
+        {
+            break;
+        }
+    }
+}
+
+template <typename... StageTs>
+inline auto EntityPipeline<StageTs...>::Collect() const
+{
+    if constexpr (std::is_same_v<ValueType, Entity>)
+    {
+        EntitySet::EntityStorage entities(resource_);
+        ForEach([&entities](Entity entity) { entities.push_back(entity); });
+        return EntitySet(std::move(entities), sorted_ && kKeepsOrder);
+    }
+    else
+    {
+        std::vector<ValueType> values;
+        ForEach([&values](auto&& value) { values.push_back(std::forward<decltype(value)>(value)); });
+        return values;
+    }
+}
+
+inline EntityPipeline<> EntitySet::Lazy() const&
+{
+    return EntityPipeline<>(
+        entities_.data(), entities_.data() + entities_.size(), sorted_, entities_.get_allocator().resource());
+}
+
+inline EntityPipeline<> EntitySet::Lazy() &&
+{
+    return EntityPipeline<>(std::move(entities_), sorted_);
 }
 }  // namespace yecs
@@ -0,0 +1,167 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace yecs
+{
+/**
+ * @brief Linear allocator for transient data living until the end of a frame.
+ *
+ * Allocations bump a pointer in a block taken from the upstream resource, deallocations are no-ops and
+ * memory is reclaimed all at once by Reset. Unlike std::pmr::monotonic_buffer_resource, Reset keeps the
+ * memory: blocks used during a frame are merged into one block large enough for the whole frame, so once
+ * the peak usage is reached frames do not touch the upstream resource at all.
+ *
+ * World keeps an arena per thread and resets them at the start of World::Run. Allocations are guarded by
+ * a mutex which is only contended if data allocated by one thread is copied from another.
+ **/
+class FrameArena : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+    explicit FrameArena(size_t                      block_size = kDefaultBlockSize,
+                        std::pmr::memory_resource* upstream   = std::pmr::new_delete_resource()) noexcept
+        : upstream_(upstream), block_size_(block_size)
+    {
+    }
+
+    ~FrameArena() override { Release(); }
+
+    // Copies are forbidden.
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Reclaim all allocations, memory stays with the arena.
+    void Reset();
+
+    // Number of bytes allocated since the last Reset (including alignment padding).
+    size_t used() const noexcept { return used_; }
+    // Number of bytes taken from the upstream resource.
+    size_t capacity() const noexcept { return capacity_; }
+
+private:
+    // Block of upstream memory.
+    struct Block
+    {
+        std::byte* data;
+        size_t     size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void*, size_t, size_t) override {}
+    bool  do_is_equal(const std::pmr::memory_resource& rhs) const noexcept override { return this == &rhs; }
+
+    // Take a block of at least size bytes from upstream and make it current.
+    void AddBlock(size_t size);
+
+    // Return all blocks to upstream.
+    void Release() noexcept;
+
+    // Upstream resource.
+    std::pmr::memory_resource* upstream_;
+    // Size of the first block.
+    size_t block_size_;
+    // Blocks in order of allocation, the last one is current.
+    std::vector<Block> blocks_;
+    // Free space of the current block.
+    std::byte* current_ = nullptr;
+    std::byte* end_     = nullptr;
+    // Statistics.
+    size_t used_     = 0;
+    size_t capacity_ = 0;
+    // Guards allocations.
+    std::mutex mutex_;
+};
+
+inline void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto aligned = [alignment](std::byte* p) {
+        auto address = reinterpret_cast<std::uintptr_t>(p);
+        return p + ((alignment - address % alignment) % alignment);
+    };
+
+    auto p = aligned(current_);
+    // Aligning might step past the end of the block.
+    if (!current_ || p > end_ || bytes > static_cast<size_t>(end_ - p))
+    {
+        // Blocks grow geometrically, so a frame needs a logarithmic number of them.
+        AddBlock(std::max(bytes + alignment, std::max(block_size_, capacity_)));
+        p = aligned(current_);
+    }
+
+    used_ += static_cast<size_t>(p + bytes - current_);
+    current_ = p + bytes;
+    return p;
+}
+
+inline void FrameArena::AddBlock(size_t size)
+{
+    // Make room first, so the block is not leaked if the list can not grow.
+    blocks_.reserve(blocks_.size() + 1);
+
+    Block block{static_cast<std::byte*>(upstream_->allocate(size, alignof(std::max_align_t))), size};
+    blocks_.push_back(block);
+
+    current_ = block.data;
+    end_     = block.data + size;
+    capacity_ += size;
+}
+
+inline void FrameArena::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Several blocks are replaced by a single one, so the next frame of the same size does not allocate.
+    if (blocks_.size() > 1)
+    {
+        auto size = capacity_;
+        Release();
+        AddBlock(size);
+    }
+
+    current_ = blocks_.empty() ? nullptr : blocks_.front().data;
+    used_    = 0;
+}
+
+inline void FrameArena::Release() noexcept
+{
+    for (auto& block : blocks_) { upstream_->deallocate(block.data, block.size, alignof(std::max_align_t)); }
+
+    blocks_.clear();
+    current_  = nullptr;
+    end_      = nullptr;
+    capacity_ = 0;
+}
+}  // namespace yecs
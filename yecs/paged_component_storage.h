@@ -0,0 +1,312 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+#include "yecs/sparse_set.h"
+
+namespace yecs
+{
+/** @brief Component storage with stable component addresses.
+ *
+ * Components live in fixed-size pages which are never moved or reallocated, so references returned by
+ * AddComponent and GetComponent stay valid until the component is removed. Slots of removed components
+ * are reused by subsequent additions, Reserve allocates pages up front without touching existing components.
+ *
+ * Entity to component mapping is a SparseSet, a packed array of slot indices parallel to its entity array
+ * keeps iteration by ComponentIndex dense.
+ **/
+template <typename T, size_t PageSize = 1024>
+class PagedComponentStorage : public ComponentStorageBase
+{
+public:
+    static_assert((PageSize & (PageSize - 1)) == 0, "PagedComponentStorage: page size should be a power of two");
+
+    explicit PagedComponentStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : pages_(resource), index_(resource), slots_(resource), free_slots_(resource)
+    {
+    }
+    ~PagedComponentStorage() override;
+
+    PagedComponentStorage(const PagedComponentStorage&) = delete;
+    PagedComponentStorage& operator=(const PagedComponentStorage&) = delete;
+
+    PagedComponentStorage(PagedComponentStorage&&) = default;
+    PagedComponentStorage& operator=(PagedComponentStorage&&) = delete;
+
+    // Get collection size.
+    size_t size() const override { return slots_.size(); }
+
+    // Number of components storage can hold without allocating pages.
+    size_t capacity() const { return pages_.size() * PageSize; }
+
+    // True if entity has a component in this collection.
+    bool HasComponent(Entity entity) const override { return index_.Contains(entity); }
+
+    // Remove component from entity.
+    void RemoveComponent(Entity entity) override;
+
+    // Remove components from a batch of entities, components which are left do not move.
+    void RemoveComponents(const Entity* entities, size_t count) override;
+
+    // Add a copy of the component of source entity to every entity of a range.
+    void CloneComponent(Entity source, const EntityRange& entities) override
+    {
+        detail::CloneComponent<T>(*this, source, entities);
+    }
+
+    // Get component for entity, throws std::runtime_error if
+    // HasComponent(entity) == false.
+    T&       GetComponent(Entity entity);
+    const T& GetComponent(Entity entity) const;
+
+    // Get pointer to a component for entity or nullptr if entity does not have a component.
+    T*       FindComponent(Entity entity);
+    const T* FindComponent(Entity entity) const;
+
+    // Add a value-initialized component to an entity.
+    T& AddComponent(Entity entity) { return EmplaceComponent(entity); }
+
+    // Add a component to an entity constructing it in place from args.
+    template <typename... Args>
+    T& EmplaceComponent(Entity entity, Args&&... args);
+
+    // Add a copy of value to every entity of a range, none of them should have a component.
+    void AddComponents(const EntityRange& entities, const T& value);
+
+    // Allocate pages for at least capacity components.
+    void Reserve(size_t capacity) override;
+
+    // Access component by index.
+    T&       operator[](ComponentIndex index) { return *Slot(slots_[index]); }
+    const T& operator[](ComponentIndex index) const { return *Slot(slots_[index]); }
+
+    // Entity owning a component at index.
+    Entity entity(ComponentIndex index) const { return index_.entity(index); }
+
+private:
+    // Uninitialized storage for a component.
+    struct alignas(T) Storage
+    {
+        std::byte data[sizeof(T)];
+    };
+
+    // Const accessors return const references, so constness of pages is dropped here.
+    T* Slot(size_t slot) const
+    {
+        auto& storage = const_cast<Storage&>(pages_[slot / PageSize][slot & (PageSize - 1)]);
+        return std::launder(reinterpret_cast<T*>(storage.data));
+    }
+
+    // Take a free slot allocating a page if needed.
+    size_t AllocateSlot();
+
+    // Component pages, page arrays are never resized.
+    std::pmr::vector<std::pmr::vector<Storage>> pages_;
+    // Entity -> component index.
+    SparseSet index_;
+    // Slot of each component, parallel to entities of index_.
+    std::pmr::vector<size_t> slots_;
+    // Slots of removed components.
+    std::pmr::vector<size_t> free_slots_;
+    // Number of slots ever used.
+    size_t num_slots_ = 0;
+};
+
+template <typename T, size_t PageSize>
+inline PagedComponentStorage<T, PageSize>::~PagedComponentStorage()
+{
+    for (auto slot : slots_) { Slot(slot)->~T(); }
+}
+
+template <typename T, size_t PageSize>
+inline void PagedComponentStorage<T, PageSize>::Reserve(size_t capacity)
+{
+    while (this->capacity() < capacity) { pages_.emplace_back(PageSize); }
+}
+
+template <typename T, size_t PageSize>
+template <typename... Args>
+inline T& PagedComponentStorage<T, PageSize>::EmplaceComponent(Entity entity, Args&&... args)
+{
+    if (HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity already has a component");
+    }
+
+    auto slot = AllocateSlot();
+    T*   component;
+
+    try
+    {
+        component = new (Slot(slot)) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        free_slots_.push_back(slot);
+        throw;
+    }
+
+    index_.Insert(entity);
+    slots_.push_back(slot);
+    return *component;
+}
+
+template <typename T, size_t PageSize>
+inline void PagedComponentStorage<T, PageSize>::AddComponents(const EntityRange& entities, const T& value)
+{
+    for (auto entity : entities)
+    {
+        if (HasComponent(entity))
+        {
+            throw std::runtime_error("ComponentCollection: Entity already has a component");
+        }
+    }
+
+    // Free slots are reused first, the rest comes from the pages past num_slots_.
+    auto fresh = entities.size() - std::min(entities.size(), free_slots_.size());
+    Reserve(num_slots_ + fresh);
+    index_.Reserve(slots_.size() + entities.size());
+    slots_.reserve(slots_.size() + entities.size());
+
+    for (auto entity : entities)
+    {
+        auto slot = AllocateSlot();
+        new (Slot(slot)) T(value);
+
+        index_.Insert(entity);
+        slots_.push_back(slot);
+    }
+}
+
+template <typename T, size_t PageSize>
+inline void PagedComponentStorage<T, PageSize>::RemoveComponents(const Entity* entities, size_t count)
+{
+    std::pmr::vector<size_t> freed(count, slots_.get_allocator());
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto index = index_.IndexOf(entities[i]);
+
+        if (index == kInvalidComponentIndex)
+        {
+            throw std::runtime_error("ComponentCollection: Entity does not have a component");
+        }
+
+        freed[i] = slots_[index];
+    }
+
+    // Only slot numbers are compacted, index_ throws before any change if an entity repeats.
+    index_.Remove(entities, count, [this](ComponentIndex from, ComponentIndex to) { slots_[to] = slots_[from]; });
+    slots_.resize(index_.size());
+
+    for (auto slot : freed)
+    {
+        Slot(slot)->~T();
+        free_slots_.push_back(slot);
+    }
+}
+
+template <typename T, size_t PageSize>
+inline size_t PagedComponentStorage<T, PageSize>::AllocateSlot()
+{
+    // Reuse the most recently freed slot, it is likely to be cache resident.
+    if (!free_slots_.empty())
+    {
+        auto slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+
+    Reserve(num_slots_ + 1);
+    return num_slots_++;
+}
+
+template <typename T, size_t PageSize>
+inline const T* PagedComponentStorage<T, PageSize>::FindComponent(Entity entity) const
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? Slot(slots_[index]) : nullptr;
+}
+
+template <typename T, size_t PageSize>
+inline T* PagedComponentStorage<T, PageSize>::FindComponent(Entity entity)
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? Slot(slots_[index]) : nullptr;
+}
+
+template <typename T, size_t PageSize>
+inline const T& PagedComponentStorage<T, PageSize>::GetComponent(Entity entity) const
+{
+    auto component = FindComponent(entity);
+
+    if (!component)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return *component;
+}
+
+template <typename T, size_t PageSize>
+inline T& PagedComponentStorage<T, PageSize>::GetComponent(Entity entity)
+{
+    auto component = FindComponent(entity);
+
+    if (!component)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return *component;
+}
+
+template <typename T, size_t PageSize>
+inline void PagedComponentStorage<T, PageSize>::RemoveComponent(Entity entity)
+{
+    if (!HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    // Only slot indices are swapped, components themselves never move.
+    auto index = index_.Remove(entity);
+    auto slot  = slots_[index];
+
+    slots_[index] = slots_.back();
+    slots_.pop_back();
+
+    Slot(slot)->~T();
+    free_slots_.push_back(slot);
+}
+}  // namespace yecs
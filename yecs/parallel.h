@@ -0,0 +1,243 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Disable warning as error for VS2019 build, taskflow has mutliple type conversion producing warning.
+// As of Jan 4 2020, there is a pending pull request for that: https://github.com/cpp-taskflow/cpp-taskflow/pull/135
+#ifdef _WIN32
+#pragma warning(push)
+#pragma warning(disable : 4267)
+#endif
+#include "third_party/cpp-taskflow/taskflow/taskflow.hpp"
+#ifdef _WIN32
+#pragma warning(pop)
+#endif
+
+#include "yecs/archetype.h"
+#include "yecs/cached_query.h"
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+#include "yecs/entity_set.h"
+#include "yecs/view.h"
+
+namespace yecs
+{
+// Default number of elements processed by a single task.
+constexpr size_t kDefaultGrainSize = 4096;
+
+namespace detail
+{
+// Split [0, size) into chunks of grain_size elements and emplace a task per chunk into a subflow.
+template <typename F>
+inline void ParallelFor(tf::Subflow& subflow, size_t size, size_t grain_size, F&& f)
+{
+    grain_size = std::max<size_t>(grain_size, 1);
+
+    for (size_t begin = 0; begin < size; begin += grain_size)
+    {
+        auto end = std::min(begin + grain_size, size);
+        subflow.emplace([f, begin, end]() { f(begin, end); });
+    }
+}
+}  // namespace detail
+
+/**
+ * @brief Process entities of a view in parallel.
+ *
+ * The driving storage of a view is split into chunks of grain_size entities, each chunk is processed
+ * by a separate task spawned in the system subflow and scheduled by the world executor. The subflow joins
+ * the system task, so all the chunks are complete before any system succeeding this one runs.
+ * View and function are captured by value, so they do not need to outlive System::Run.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param view View to iterate.
+ * @param f Function with the signature void(Entity, ComponentTs&...), called concurrently.
+ * @param grain_size Number of entities processed by a single task.
+ **/
+template <typename F, typename... ComponentTs>
+inline void ParallelForEach(tf::Subflow&               subflow,
+                            const View<ComponentTs...>& view,
+                            F&&                         f,
+                            size_t                      grain_size = kDefaultGrainSize)
+{
+    auto fn = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    detail::ParallelFor(subflow, view.size_hint(), grain_size, [view, fn](size_t begin, size_t end) {
+        view.ForEach(begin, end, *fn);
+    });
+}
+
+/**
+ * @brief Process entities of an archetype view in parallel.
+ *
+ * Chunks of matching archetypes are grouped into tasks of at least grain_size entities.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param view Archetype view to iterate.
+ * @param f Function with the signature void(Entity, ComponentTs&...), called concurrently.
+ * @param grain_size Number of entities processed by a single task.
+ **/
+template <typename F, typename... ComponentTs>
+inline void ParallelForEach(tf::Subflow&                         subflow,
+                            const ArchetypeView<ComponentTs...>& view,
+                            F&&                                  f,
+                            size_t                               grain_size = kDefaultGrainSize)
+{
+    using Chunks = std::vector<std::pair<typename ArchetypeView<ComponentTs...>::ArchetypeType*, size_t>>;
+
+    auto fn     = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    auto chunks = std::make_shared<Chunks>();
+    auto sizes  = std::vector<size_t>();
+
+    for (auto& archetype : view.table().archetypes())
+    {
+        if (view.Matches(*archetype))
+        {
+            for (auto chunk = 0u; chunk < archetype->num_chunks(); ++chunk)
+            {
+                chunks->emplace_back(archetype.get(), chunk);
+                sizes.push_back(archetype->chunk_size(chunk));
+            }
+        }
+    }
+
+    // Group consecutive chunks until there are enough entities for a task.
+    size_t begin = 0;
+    size_t count = 0;
+
+    for (size_t i = 0; i < chunks->size(); ++i)
+    {
+        count += sizes[i];
+
+        if (count >= grain_size || i + 1 == chunks->size())
+        {
+            subflow.emplace([view, fn, chunks, begin, end = i + 1]() {
+                for (auto c = begin; c < end; ++c) { view.ForEach(*(*chunks)[c].first, (*chunks)[c].second, *fn); }
+            });
+
+            begin = i + 1;
+            count = 0;
+        }
+    }
+}
+
+/**
+ * @brief Process components of a storage in parallel.
+ *
+ * Storage should provide indexed access (size(), entity(index), operator[](index)), like
+ * DenseComponentStorage does. Storage should not be structurally modified
+ * until the subflow joins.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param storage Storage to iterate.
+ * @param f Function with the signature void(Entity, ComponentT&), called concurrently.
+ * @param grain_size Number of components processed by a single task.
+ **/
+template <typename F,
+          typename StorageT,
+          typename = std::enable_if_t<std::is_base_of_v<ComponentStorageBase, std::remove_const_t<StorageT>>>>
+inline void ParallelForEach(tf::Subflow& subflow, StorageT& storage, F&& f, size_t grain_size = kDefaultGrainSize)
+{
+    auto fn = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    detail::ParallelFor(subflow, storage.size(), grain_size, [&storage, fn](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) { (*fn)(storage.entity(i), storage[i]); }
+    });
+}
+
+/**
+ * @brief Process entities of an entity set in parallel.
+ *
+ * Entity set is moved into the tasks, so a temporary returned by EntityQuery can be passed directly.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param entities Entities to process.
+ * @param f Function with the signature void(Entity), called concurrently.
+ * @param grain_size Number of entities processed by a single task.
+ **/
+template <typename F>
+inline void ParallelForEach(tf::Subflow& subflow, EntitySet entities, F&& f, size_t grain_size = kDefaultGrainSize)
+{
+    auto fn  = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    auto set = std::make_shared<EntitySet>(std::move(entities));
+    detail::ParallelFor(subflow, set->entities().size(), grain_size, [set, fn](size_t begin, size_t end) {
+        auto& e = set->entities();
+        for (auto i = begin; i < end; ++i) { (*fn)(e[i]); }
+    });
+}
+
+/**
+ * @brief Process entities of a cached query in parallel.
+ *
+ * Query is owned by World and is captured by reference, it should not change until the subflow joins.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param query Query to process.
+ * @param f Function with the signature void(Entity), called concurrently.
+ * @param grain_size Number of entities processed by a single task.
+ **/
+template <typename F>
+inline void ParallelForEach(tf::Subflow&       subflow,
+                            const CachedQuery& query,
+                            F&&                f,
+                            size_t             grain_size = kDefaultGrainSize)
+{
+    auto fn = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    detail::ParallelFor(subflow, query.size(), grain_size, [&query, fn](size_t begin, size_t end) {
+        auto& e = query.entities();
+        for (auto i = begin; i < end; ++i) { (*fn)(e[i]); }
+    });
+}
+
+/**
+ * @brief Process values of a lazy entity pipeline in parallel.
+ *
+ * Source entities are split into chunks of grain_size entities, every chunk runs the whole pipeline.
+ * Pipeline is moved into the tasks, so it can be built in place, its source entities should not change
+ * until the subflow joins. Pipelines with Take stages depend on processing order and are not accepted.
+ *
+ * @param subflow Subflow passed to System::Run.
+ * @param pipeline Pipeline to run.
+ * @param f Function with the signature void(ValueType), called concurrently.
+ * @param grain_size Number of source entities processed by a single task.
+ **/
+template <typename F, typename... StageTs>
+inline void ParallelForEach(tf::Subflow&               subflow,
+                            EntityPipeline<StageTs...> pipeline,
+                            F&&                        f,
+                            size_t                     grain_size = kDefaultGrainSize)
+{
+    static_assert(!EntityPipeline<StageTs...>::kOrdered, "Pipelines with Take stages can not run in parallel");
+
+    auto fn  = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+    auto run = std::make_shared<EntityPipeline<StageTs...>>(std::move(pipeline));
+    detail::ParallelFor(subflow, run->size_hint(), grain_size, [run, fn](size_t begin, size_t end) {
+        run->ForEach(begin, end, *fn);
+    });
+}
+}  // namespace yecs
@@ -0,0 +1,91 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+
+namespace yecs
+{
+// Query term: entity should have all of the components.
+template <typename... ComponentTs>
+struct With
+{
+};
+
+// Query term: entity should have none of the components.
+template <typename... ComponentTs>
+struct Without
+{
+};
+
+// Query term: components are passed to EntityQuery::ForEach callback as pointers, nullptr if entity does not have one.
+template <typename... ComponentTs>
+struct Optional
+{
+};
+
+namespace detail
+{
+// Component type lists of a single query term.
+template <typename TermT>
+struct QueryTerm
+{
+    static_assert(sizeof(TermT) == 0, "Query term should be With<...>, Without<...> or Optional<...>");
+};
+
+template <typename... ComponentTs>
+struct QueryTerm<With<ComponentTs...>>
+{
+    using WithTypes     = std::tuple<ComponentTs...>;
+    using WithoutTypes  = std::tuple<>;
+    using OptionalTypes = std::tuple<>;
+};
+
+template <typename... ComponentTs>
+struct QueryTerm<Without<ComponentTs...>>
+{
+    using WithTypes     = std::tuple<>;
+    using WithoutTypes  = std::tuple<ComponentTs...>;
+    using OptionalTypes = std::tuple<>;
+};
+
+template <typename... ComponentTs>
+struct QueryTerm<Optional<ComponentTs...>>
+{
+    using WithTypes     = std::tuple<>;
+    using WithoutTypes  = std::tuple<>;
+    using OptionalTypes = std::tuple<ComponentTs...>;
+};
+
+// Component type lists of a query, terms of the same kind are concatenated in order.
+template <typename... TermTs>
+struct QueryTerms
+{
+    using WithTypes     = decltype(std::tuple_cat(std::declval<typename QueryTerm<TermTs>::WithTypes>()...));
+    using WithoutTypes  = decltype(std::tuple_cat(std::declval<typename QueryTerm<TermTs>::WithoutTypes>()...));
+    using OptionalTypes = decltype(std::tuple_cat(std::declval<typename QueryTerm<TermTs>::OptionalTypes>()...));
+};
+}  // namespace detail
+}  // namespace yecs
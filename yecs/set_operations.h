@@ -0,0 +1,163 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "yecs/common.h"
+
+// SSE2 kernels compare four 32-bit entities at a time, 64-bit entities are processed by scalar merges.
+#if !defined(YECS_64BIT_ENTITY) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define YECS_SSE2_SET_OPERATIONS
+#include <emmintrin.h>
+#endif
+
+namespace yecs
+{
+namespace detail
+{
+#ifdef YECS_SSE2_SET_OPERATIONS
+// Bit i of the result is set if lane i of a is equal to any lane of b.
+inline uint32_t MatchLanes(const Entity* a, const Entity* b)
+{
+    auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+
+    // Compare against every rotation of b.
+    auto eq0 = _mm_cmpeq_epi32(va, vb);
+    auto eq1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)));
+    auto eq2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+    auto eq3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)));
+    auto eq  = _mm_or_si128(_mm_or_si128(eq0, eq1), _mm_or_si128(eq2, eq3));
+
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+}
+#endif
+
+/**
+ * @brief Write entities present in both of the sorted arrays to out.
+ *
+ * Arrays should be sorted in ascending order and have no repeats, out should have space for min(na, nb)
+ * entities. Returns the number of entities written, out is sorted.
+ **/
+inline size_t IntersectSorted(const Entity* a, size_t na, const Entity* b, size_t nb, Entity* out)
+{
+    size_t i = 0, j = 0, k = 0;
+
+#ifdef YECS_SSE2_SET_OPERATIONS
+    // Compare blocks of four entities, the block having smaller maximum can not match anything further.
+    while (i + 4 <= na && j + 4 <= nb)
+    {
+        for (auto mask = MatchLanes(a + i, b + j); mask; mask &= mask - 1) { out[k++] = a[i + CountTrailingZeros(mask)]; }
+
+        auto amax = a[i + 3];
+        auto bmax = b[j + 3];
+        i += amax <= bmax ? 4 : 0;
+        j += bmax <= amax ? 4 : 0;
+    }
+#endif
+
+    while (i < na && j < nb)
+    {
+        if (a[i] < b[j])
+        {
+            ++i;
+        }
+        else if (b[j] < a[i])
+        {
+            ++j;
+        }
+        else
+        {
+            out[k++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+
+    return k;
+}
+
+/**
+ * @brief Write entities of sorted array a which are not in sorted array b to out.
+ *
+ * Arrays should be sorted in ascending order and have no repeats, out should have space for na entities.
+ * Returns the number of entities written, out is sorted.
+ **/
+inline size_t SubtractSorted(const Entity* a, size_t na, const Entity* b, size_t nb, Entity* out)
+{
+    size_t i = 0, j = 0, k = 0;
+    // Lanes of the current block of a found in b so far.
+    uint32_t found = 0;
+
+#ifdef YECS_SSE2_SET_OPERATIONS
+    while (i + 4 <= na && j + 4 <= nb)
+    {
+        found |= MatchLanes(a + i, b + j);
+
+        auto amax = a[i + 3];
+        auto bmax = b[j + 3];
+
+        if (amax <= bmax)
+        {
+            for (auto mask = ~found & 0xfu; mask; mask &= mask - 1) { out[k++] = a[i + CountTrailingZeros(mask)]; }
+            found = 0;
+            i += 4;
+        }
+        j += bmax <= amax ? 4 : 0;
+    }
+#endif
+
+    // Entities of the current block found in b are behind j already.
+    for (auto block = i; i < na; ++i)
+    {
+        if (i - block < 4 && ((found >> (i - block)) & 1))
+        {
+            continue;
+        }
+
+        while (j < nb && b[j] < a[i]) { ++j; }
+
+        if (j == nb || b[j] != a[i])
+        {
+            out[k++] = a[i];
+        }
+    }
+
+    return k;
+}
+
+/**
+ * @brief Write entities present in any of the sorted arrays to out.
+ *
+ * Arrays should be sorted in ascending order and have no repeats, out should have space for na + nb
+ * entities. Returns the number of entities written, out is sorted.
+ **/
+inline size_t UniteSorted(const Entity* a, size_t na, const Entity* b, size_t nb, Entity* out)
+{
+    return static_cast<size_t>(std::set_union(a, a + na, b, b + nb, out) - out);
+}
+}  // namespace detail
+}  // namespace yecs
@@ -0,0 +1,460 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+#include "yecs/sparse_set.h"
+
+namespace yecs
+{
+// Alignment of SoA field arrays, wide enough for any SIMD register and a cache line.
+constexpr size_t kSoAAlignment = 64;
+
+/**
+ * @brief Allocator returning memory aligned to Alignment bytes from a memory resource.
+ **/
+template <typename T, size_t Alignment = kSoAAlignment>
+class AlignedAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept
+        : resource_(resource)
+    {
+    }
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>& rhs) noexcept : resource_(rhs.resource())
+    {
+    }
+
+    T*   allocate(size_t n) { return static_cast<T*>(resource_->allocate(n * sizeof(T), Alignment)); }
+    void deallocate(T* ptr, size_t n) noexcept { resource_->deallocate(ptr, n * sizeof(T), Alignment); }
+
+    std::pmr::memory_resource* resource() const noexcept { return resource_; }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>& rhs) const noexcept
+    {
+        return *resource_ == *rhs.resource();
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    std::pmr::memory_resource* resource_;
+};
+
+/**
+ * @brief List of data members of a component stored as separate arrays by SoAComponentStorage.
+ **/
+template <auto... Members>
+struct SoAFieldList
+{
+    static constexpr auto kMembers = std::make_tuple(Members...);
+};
+
+/**
+ * @brief Describes fields of a component for SoAComponentStorage.
+ *
+ * Specialize this template for every component stored in SoAComponentStorage, listing all of its data members:
+ * template <> struct SoAFields<Body> : SoAFieldList<&Body::x, &Body::y, &Body::vx, &Body::vy> {};
+ **/
+template <typename T>
+struct SoAFields;
+
+/** @brief Component storage keeping every field of a component in a separate aligned array.
+ *
+ * Kernels touching only some of the fields stream through these fields only and vectorize well:
+ * storage.data<&Body::x>() is an array of size() floats aligned to kSoAAlignment.
+ * Per-entity access goes through Reference proxies gathering and scattering the fields.
+ * Entity to component mapping is a SparseSet, removal is swap-and-pop in every field array.
+ *
+ * Since components are not stored as objects, SoA storages can not be used in View, systems should
+ * iterate field arrays instead. Field arrays of two different storages are not ordered the same way, so
+ * data processed together (like position and velocity) should be fields of the same component.
+ **/
+template <typename T>
+class SoAComponentStorage : public ComponentStorageBase
+{
+public:
+    static_assert(std::is_default_constructible_v<T>, "SoAComponentStorage: component should be default constructible");
+
+    // Array of a field.
+    template <typename FieldT>
+    using FieldArray = std::vector<FieldT, AlignedAllocator<FieldT>>;
+
+    class Reference;
+    class ConstReference;
+
+    explicit SoAComponentStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : index_(resource), fields_(MakeFields(resource, std::make_index_sequence<kNumFields>()))
+    {
+    }
+    ~SoAComponentStorage() override = default;
+
+    SoAComponentStorage(const SoAComponentStorage&) = delete;
+    SoAComponentStorage& operator=(const SoAComponentStorage&) = delete;
+
+    SoAComponentStorage(SoAComponentStorage&&) = default;
+    SoAComponentStorage& operator=(SoAComponentStorage&&) = default;
+
+    // Get collection size.
+    size_t size() const override { return index_.size(); }
+
+    // True if entity has a component in this collection.
+    bool HasComponent(Entity entity) const override { return index_.Contains(entity); }
+
+    // Remove component from entity.
+    void RemoveComponent(Entity entity) override;
+
+    // Remove components from a batch of entities compacting every field array in one pass.
+    void RemoveComponents(const Entity* entities, size_t count) override;
+
+    // Reserve space for at least capacity components in every field array.
+    void Reserve(size_t capacity) override;
+
+    // Add a copy of the component of source entity to every entity of a range.
+    void CloneComponent(Entity source, const EntityRange& entities) override
+    {
+        detail::CloneComponent<T>(*this, source, entities);
+    }
+
+    // Get component proxy for entity, throws std::runtime_error if
+    // HasComponent(entity) == false.
+    Reference      GetComponent(Entity entity);
+    ConstReference GetComponent(Entity entity) const;
+
+    // Get component proxy for entity or std::nullopt if entity does not have a component.
+    std::optional<Reference>      FindComponent(Entity entity);
+    std::optional<ConstReference> FindComponent(Entity entity) const;
+
+    // Add a default constructed component to an entity.
+    Reference AddComponent(Entity entity) { return EmplaceComponent(entity); }
+
+    // Add a component constructed from args to an entity, fields of the component are copied into the arrays.
+    template <typename... Args>
+    Reference EmplaceComponent(Entity entity, Args&&... args);
+
+    // Add a copy of value to every entity of a range, none of them should have a component.
+    void AddComponents(const EntityRange& entities, const T& value);
+
+    // Access component by index.
+    Reference      operator[](ComponentIndex index) { return Reference(this, index); }
+    ConstReference operator[](ComponentIndex index) const { return ConstReference(this, index); }
+
+    // Entity owning a component at index.
+    Entity entity(ComponentIndex index) const { return index_.entity(index); }
+
+    // Array of a field with size() elements, aligned to kSoAAlignment.
+    template <auto Member>
+    auto* data()
+    {
+        return std::get<FieldIndex<Member>()>(fields_).data();
+    }
+    template <auto Member>
+    const auto* data() const
+    {
+        return std::get<FieldIndex<Member>()>(fields_).data();
+    }
+
+private:
+    // Data member pointer type -> member type.
+    template <typename MemberT>
+    struct MemberTraits;
+    template <typename FieldT, typename ClassT>
+    struct MemberTraits<FieldT ClassT::*>
+    {
+        using type = FieldT;
+    };
+
+    static constexpr auto kMembers   = SoAFields<T>::kMembers;
+    static constexpr auto kNumFields = std::tuple_size_v<std::remove_const_t<decltype(kMembers)>>;
+
+    template <size_t... I>
+    static auto MakeFields(std::index_sequence<I...>)
+        -> std::tuple<FieldArray<typename MemberTraits<std::tuple_element_t<I, std::remove_const_t<decltype(kMembers)>>>::type>...>;
+
+    using Fields = decltype(MakeFields(std::make_index_sequence<kNumFields>()));
+
+    // Field arrays allocating from a resource.
+    template <size_t... I>
+    static Fields MakeFields(std::pmr::memory_resource* resource, std::index_sequence<I...>)
+    {
+        return Fields(std::tuple_element_t<I, Fields>(resource)...);
+    }
+
+    // Position of a member in the field list, kNumFields if the member is not listed.
+    template <auto Member, size_t I = 0>
+    static constexpr size_t FindField()
+    {
+        if constexpr (I == kNumFields)
+        {
+            return kNumFields;
+        }
+        else if constexpr (std::is_same_v<std::decay_t<decltype(std::get<I>(kMembers))>, decltype(Member)>)
+        {
+            return std::get<I>(kMembers) == Member ? I : FindField<Member, I + 1>();
+        }
+        else
+        {
+            return FindField<Member, I + 1>();
+        }
+    }
+
+    template <auto Member>
+    static constexpr size_t FieldIndex()
+    {
+        static_assert(FindField<Member>() < kNumFields, "SoAComponentStorage: member is not listed in SoAFields");
+        return FindField<Member>();
+    }
+
+    // Copy component fields into the arrays at index.
+    template <typename U, size_t... I>
+    void Scatter(size_t index, U&& value, std::index_sequence<I...>)
+    {
+        ((std::get<I>(fields_)[index] = std::forward<U>(value).*std::get<I>(kMembers)), ...);
+    }
+
+    // Append count copies of component fields to the arrays.
+    template <size_t... I>
+    void Fill(size_t count, const T& value, std::index_sequence<I...>)
+    {
+        (std::get<I>(fields_).insert(std::get<I>(fields_).end(), count, value.*std::get<I>(kMembers)), ...);
+    }
+
+    // Assemble a component from the arrays at index.
+    template <size_t... I>
+    T Gather(size_t index, std::index_sequence<I...>) const
+    {
+        T value;
+        ((value.*std::get<I>(kMembers) = std::get<I>(fields_)[index]), ...);
+        return value;
+    }
+
+    SparseSet index_;
+    Fields    fields_;
+};
+
+/**
+ * @brief Proxy reference to a component in SoAComponentStorage.
+ *
+ * ref.get<&Body::x>() returns a reference to a field, a proxy converts to T and can be assigned from T.
+ **/
+template <typename T>
+class SoAComponentStorage<T>::Reference
+{
+public:
+    // Reference to a field.
+    template <auto Member>
+    auto& get() const
+    {
+        return std::get<FieldIndex<Member>()>(storage_->fields_)[index_];
+    }
+
+    // Assemble a component.
+    operator T() const { return storage_->Gather(index_, std::make_index_sequence<kNumFields>()); }
+
+    // Overwrite all the fields.
+    const Reference& operator=(const T& value) const
+    {
+        storage_->Scatter(index_, value, std::make_index_sequence<kNumFields>());
+        return *this;
+    }
+    const Reference& operator=(T&& value) const
+    {
+        storage_->Scatter(index_, std::move(value), std::make_index_sequence<kNumFields>());
+        return *this;
+    }
+
+private:
+    Reference(SoAComponentStorage* storage, size_t index) noexcept : storage_(storage), index_(index) {}
+
+    SoAComponentStorage* storage_;
+    size_t               index_;
+
+    friend class SoAComponentStorage;
+    friend class ConstReference;
+};
+
+/**
+ * @brief Proxy const reference to a component in SoAComponentStorage.
+ **/
+template <typename T>
+class SoAComponentStorage<T>::ConstReference
+{
+public:
+    ConstReference(const Reference& rhs) noexcept : storage_(rhs.storage_), index_(rhs.index_) {}
+
+    // Const reference to a field.
+    template <auto Member>
+    const auto& get() const
+    {
+        return std::get<FieldIndex<Member>()>(storage_->fields_)[index_];
+    }
+
+    // Assemble a component.
+    operator T() const { return storage_->Gather(index_, std::make_index_sequence<kNumFields>()); }
+
+private:
+    ConstReference(const SoAComponentStorage* storage, size_t index) noexcept : storage_(storage), index_(index) {}
+
+    const SoAComponentStorage* storage_;
+    size_t                     index_;
+
+    friend class SoAComponentStorage;
+};
+
+template <typename T>
+template <typename... Args>
+inline typename SoAComponentStorage<T>::Reference SoAComponentStorage<T>::EmplaceComponent(Entity entity,
+                                                                                           Args&&... args)
+{
+    if (HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity already has a component");
+    }
+
+    T value(std::forward<Args>(args)...);
+
+    auto index = index_.Insert(entity);
+    std::apply([](auto&... arrays) { (arrays.emplace_back(), ...); }, fields_);
+    Scatter(index, std::move(value), std::make_index_sequence<kNumFields>());
+    return Reference(this, index);
+}
+
+template <typename T>
+inline void SoAComponentStorage<T>::AddComponents(const EntityRange& entities, const T& value)
+{
+    for (auto entity : entities)
+    {
+        if (HasComponent(entity))
+        {
+            throw std::runtime_error("ComponentCollection: Entity already has a component");
+        }
+    }
+
+    Reserve(size() + entities.size());
+
+    for (auto entity : entities) { index_.Insert(entity); }
+
+    Fill(entities.size(), value, std::make_index_sequence<kNumFields>());
+}
+
+template <typename T>
+inline void SoAComponentStorage<T>::Reserve(size_t capacity)
+{
+    index_.Reserve(capacity);
+    std::apply([capacity](auto&... arrays) { (arrays.reserve(capacity), ...); }, fields_);
+}
+
+template <typename T>
+inline void SoAComponentStorage<T>::RemoveComponents(const Entity* entities, size_t count)
+{
+    index_.Remove(entities, count, [this](ComponentIndex from, ComponentIndex to) {
+        std::apply([from, to](auto&... arrays) { ((arrays[to] = arrays[from]), ...); }, fields_);
+    });
+    std::apply([size = index_.size()](auto&... arrays) { (arrays.resize(size), ...); }, fields_);
+}
+
+template <typename T>
+inline std::optional<typename SoAComponentStorage<T>::ConstReference> SoAComponentStorage<T>::FindComponent(
+    Entity entity) const
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? std::optional<ConstReference>(ConstReference(this, index)) : std::nullopt;
+}
+
+template <typename T>
+inline std::optional<typename SoAComponentStorage<T>::Reference> SoAComponentStorage<T>::FindComponent(Entity entity)
+{
+    auto index = index_.IndexOf(entity);
+    return index != kInvalidComponentIndex ? std::optional<Reference>(Reference(this, index)) : std::nullopt;
+}
+
+template <typename T>
+inline typename SoAComponentStorage<T>::ConstReference SoAComponentStorage<T>::GetComponent(Entity entity) const
+{
+    auto index = index_.IndexOf(entity);
+
+    if (index == kInvalidComponentIndex)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return ConstReference(this, index);
+}
+
+template <typename T>
+inline typename SoAComponentStorage<T>::Reference SoAComponentStorage<T>::GetComponent(Entity entity)
+{
+    auto index = index_.IndexOf(entity);
+
+    if (index == kInvalidComponentIndex)
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return Reference(this, index);
+}
+
+template <typename T>
+inline void SoAComponentStorage<T>::RemoveComponent(Entity entity)
+{
+    if (!HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    auto index = index_.Remove(entity);
+
+    std::apply(
+        [index](auto&... arrays) {
+            (((index != arrays.size() - 1 ? (void)(arrays[index] = std::move(arrays.back())) : void()),
+              arrays.pop_back()),
+             ...);
+        },
+        fields_);
+}
+}  // namespace yecs
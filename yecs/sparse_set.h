@@ -0,0 +1,188 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
+
+#include "yecs/common.h"
+#include "yecs/entity_bitset.h"
+
+namespace yecs
+{
+/** @brief Maps entities to dense indices using a paged sparse array.
+ *
+ * Sparse array is indexed by entity index (see GetEntityIndex) and stores an index into a packed entity array.
+ * Pages of the sparse array are allocated on demand, so worlds with large entity ids do not pay for the unused
+ * ranges. All operations are O(1), removal is done via swap-and-pop.
+ **/
+class SparseSet
+{
+public:
+    // Number of sparse entries per page, should be a power of two.
+    static constexpr size_t kPageSize = 4096;
+
+    explicit SparseSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : pages_(resource), entities_(resource)
+    {
+    }
+    ~SparseSet() = default;
+
+    SparseSet(const SparseSet&) = delete;
+    SparseSet& operator=(const SparseSet&) = delete;
+
+    SparseSet(SparseSet&&) = default;
+    SparseSet& operator=(SparseSet&&) = default;
+
+    // Number of entities in the set.
+    size_t size() const { return entities_.size(); }
+
+    // True if entity is in the set. Only the index part of an entity is considered.
+    bool Contains(Entity entity) const { return IndexOf(entity) != kInvalidComponentIndex; }
+
+    // Dense index of an entity or kInvalidComponentIndex if entity is not in the set.
+    ComponentIndex IndexOf(Entity entity) const;
+
+    // Add entity to the set and return its dense index.
+    ComponentIndex Insert(Entity entity);
+
+    // Remove entity from the set. The last entity is moved into the vacated slot,
+    // the function returns the index of this slot, so the caller can do the same to its data.
+    ComponentIndex Remove(Entity entity);
+
+    // Remove a batch of entities, throws std::runtime_error if any of them is not in the set or repeats.
+    // Vacated slots are filled from the tail in one pass and move(from, to) is called for every relocated entity,
+    // so the caller can do the same to its data and truncate it to size().
+    template <typename F>
+    void Remove(const Entity* entities, size_t count, F&& move);
+
+    // Reserve packed entity array for at least capacity entities.
+    void Reserve(size_t capacity) { entities_.reserve(capacity); }
+
+    // Entity at a given dense index.
+    Entity entity(ComponentIndex index) const { return entities_[index]; }
+
+    // Packed entity array.
+    const std::pmr::vector<Entity>& entities() const { return entities_; }
+
+private:
+    // Get sparse entry for an entity, allocating a page if needed.
+    ComponentIndex& Assure(Entity entity);
+    // Get sparse entry for an entity known to be in the set.
+    ComponentIndex& Sparse(Entity entity)
+    {
+        auto index = GetEntityIndex(entity);
+        return pages_[index / kPageSize][index & (kPageSize - 1)];
+    }
+
+    // Sparse pages: entity index -> dense index, pages not allocated yet are empty.
+    std::pmr::vector<std::pmr::vector<ComponentIndex>> pages_;
+    // Packed entities.
+    std::pmr::vector<Entity> entities_;
+};
+
+inline ComponentIndex SparseSet::IndexOf(Entity entity) const
+{
+    auto index = GetEntityIndex(entity);
+    auto page  = index / kPageSize;
+
+    if (page >= pages_.size() || pages_[page].empty())
+    {
+        return kInvalidComponentIndex;
+    }
+
+    return pages_[page][index & (kPageSize - 1)];
+}
+
+inline ComponentIndex& SparseSet::Assure(Entity entity)
+{
+    auto index = GetEntityIndex(entity);
+    auto page  = index / kPageSize;
+
+    if (page >= pages_.size())
+    {
+        pages_.resize(page + 1);
+    }
+
+    if (pages_[page].empty())
+    {
+        pages_[page].assign(kPageSize, kInvalidComponentIndex);
+    }
+
+    return pages_[page][index & (kPageSize - 1)];
+}
+
+inline ComponentIndex SparseSet::Insert(Entity entity)
+{
+    auto& index = Assure(entity);
+    index       = entities_.size();
+    entities_.push_back(entity);
+    return index;
+}
+
+inline ComponentIndex SparseSet::Remove(Entity entity)
+{
+    auto& index = Sparse(entity);
+    auto  last  = entities_.back();
+    auto  slot  = index;
+
+    entities_[slot] = last;
+    Sparse(last)    = slot;
+    index           = kInvalidComponentIndex;
+    entities_.pop_back();
+    return slot;
+}
+
+template <typename F>
+inline void SparseSet::Remove(const Entity* entities, size_t count, F&& move)
+{
+    // Validate the whole batch before changing anything.
+    EntityBitset removed;
+    removed.resize(entities_.size());
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto index = IndexOf(entities[i]);
+
+        if (index == kInvalidComponentIndex || removed.test(static_cast<EntityIndex>(index)))
+        {
+            throw std::runtime_error("SparseSet: entity is not in the set");
+        }
+
+        removed.set(static_cast<EntityIndex>(index));
+    }
+
+    for (auto i = 0u; i < count; ++i) { Sparse(entities[i]) = kInvalidComponentIndex; }
+
+    auto size = detail::CompactRemoved(entities_.size(), removed, [this, &move](ComponentIndex from, ComponentIndex to) {
+        entities_[to]         = entities_[from];
+        Sparse(entities_[to]) = to;
+        move(from, to);
+    });
+
+    entities_.resize(size);
+}
+}  // namespace yecs
@@ -34,7 +34,10 @@ SOFTWARE.
 #pragma warning(pop)
 #endif
 
+#include <type_traits>
+
 #include "yecs/common.h"
+#include "yecs/component_types_builder.h"
 
 namespace yecs
 {
@@ -46,6 +49,16 @@ class ComponentAccess;
  *
  * World talks to registered systems via System interface calling System::Run() on every
  * registered system every time World::Run() is called.
+ *
+ * Systems can declare component types they access, which allows World to order conflicting systems
+ * automatically (see World::RegisterSystem):
+ *
+ * struct PhysicsSystem : public System
+ * {
+ *     using Reads  = ComponentTypesBuilder<Velocity>;
+ *     using Writes = ComponentTypesBuilder<Position>;
+ *     ...
+ * };
  **/
 class System
 {
@@ -57,11 +70,41 @@ public:
      * @brief Run single step of system simulation.
      *
      * World calls this method once per World::Run invocation.
-     * TODO: components access triggers a search in a components hash table every time.
      *
      * @param access API for comoponent acccess.
      * @param entity_query API for entity queries.
      **/
     virtual void Run(ComponentAccess& access, EntityQuery& entity_query, tf::Subflow& subflow) = 0;
 };
+
+namespace detail
+{
+template <typename SystemT, typename = void>
+struct SystemReads
+{
+    static constexpr bool kDeclared = false;
+    static ComponentTypes Build() { return {}; }
+};
+
+template <typename SystemT>
+struct SystemReads<SystemT, std::void_t<typename SystemT::Reads>>
+{
+    static constexpr bool kDeclared = true;
+    static ComponentTypes Build() { return typename SystemT::Reads().Build(); }
+};
+
+template <typename SystemT, typename = void>
+struct SystemWrites
+{
+    static constexpr bool kDeclared = false;
+    static ComponentTypes Build() { return {}; }
+};
+
+template <typename SystemT>
+struct SystemWrites<SystemT, std::void_t<typename SystemT::Writes>>
+{
+    static constexpr bool kDeclared = true;
+    static ComponentTypes Build() { return typename SystemT::Writes().Build(); }
+};
+}  // namespace detail
 }  // namespace yecs
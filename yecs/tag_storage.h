@@ -0,0 +1,198 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+#include "yecs/entity_bitset.h"
+
+namespace yecs
+{
+/** @brief Storage for empty (tag) components.
+ *
+ * Tag components carry no data, so the storage is just a bitset over entity indices: add, remove and
+ * lookup are single bit operations and queries intersect tags 64 entities at a time (see EntityBitset).
+ * All the tags of a type share one instance returned by AddComponent, GetComponent and FindComponent.
+ *
+ * Tag storages do not provide indexed access, so they never drive View iteration: View<Position, const Selected>
+ * iterates positions and tests the tag, while entities having tags only are queried with
+ * EntityQuery::WithComponents.
+ **/
+template <typename T>
+class TagStorage : public ComponentStorageBase
+{
+public:
+    static_assert(std::is_empty_v<T>, "TagStorage: only empty types can be stored as tags");
+
+    explicit TagStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : bits_(resource) {}
+    ~TagStorage() override = default;
+
+    TagStorage(const TagStorage&) = delete;
+    TagStorage& operator=(const TagStorage&) = delete;
+
+    TagStorage(TagStorage&&) = default;
+    TagStorage& operator=(TagStorage&&) = default;
+
+    // Get collection size.
+    size_t size() const override { return bits_.count(); }
+
+    // True if entity has a tag.
+    bool HasComponent(Entity entity) const override
+    {
+        auto index = GetEntityIndex(entity);
+        return index < bits_.size() && bits_.test(index);
+    }
+
+    // Remove tag from entity.
+    void RemoveComponent(Entity entity) override;
+
+    // Tags are keyed on entity index, nothing to reserve.
+    void Reserve(size_t) override {}
+
+    // Add a tag to every entity of a range, source entity should have a tag.
+    void CloneComponent(Entity source, const EntityRange& entities) override
+    {
+        detail::CloneComponent<T>(*this, source, entities);
+    }
+
+    // Get tag for entity, throws std::runtime_error if
+    // HasComponent(entity) == false.
+    T&       GetComponent(Entity entity);
+    const T& GetComponent(Entity entity) const;
+
+    // Get pointer to a tag for entity or nullptr if entity does not have a tag.
+    T*       FindComponent(Entity entity) { return HasComponent(entity) ? &tag_ : nullptr; }
+    const T* FindComponent(Entity entity) const { return HasComponent(entity) ? &tag_ : nullptr; }
+
+    // Add a tag to an entity.
+    T& AddComponent(Entity entity);
+
+    // Add a tag to an entity, tags are shared so constructor arguments are ignored.
+    template <typename... Args>
+    T& EmplaceComponent(Entity entity, Args&&...)
+    {
+        return AddComponent(entity);
+    }
+
+    // Add a tag to every entity of a range, value is ignored since all the tags are the same.
+    void AddComponents(const EntityRange& entities, const T& value);
+
+    // Entities having a tag, bit per entity index.
+    const EntityBitset& bits() const { return bits_; }
+
+private:
+    // Bit per entity index.
+    EntityBitset bits_;
+    // Shared tag instance.
+    T tag_;
+};
+
+// True if StorageT is a TagStorage.
+template <typename StorageT>
+struct IsTagStorage : std::false_type
+{
+};
+
+template <typename T>
+struct IsTagStorage<TagStorage<T>> : std::true_type
+{
+};
+
+template <typename T>
+inline T& TagStorage<T>::AddComponent(Entity entity)
+{
+    if (HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity already has a component");
+    }
+
+    auto index = GetEntityIndex(entity);
+
+    // Grow geometrically, so adding tags to increasing indices stays amortized O(1).
+    if (index >= bits_.size())
+    {
+        bits_.resize(std::max<size_t>(index + 1, bits_.size() * 2));
+    }
+
+    bits_.set(index);
+    return tag_;
+}
+
+template <typename T>
+inline void TagStorage<T>::AddComponents(const EntityRange& entities, const T&)
+{
+    for (auto entity : entities)
+    {
+        if (HasComponent(entity))
+        {
+            throw std::runtime_error("ComponentCollection: Entity already has a component");
+        }
+    }
+
+    if (!entities.empty() && entities.first() + entities.size() > bits_.size())
+    {
+        bits_.resize(std::max<size_t>(entities.first() + entities.size(), bits_.size() * 2));
+    }
+
+    for (auto entity : entities) { bits_.set(GetEntityIndex(entity)); }
+}
+
+template <typename T>
+inline const T& TagStorage<T>::GetComponent(Entity entity) const
+{
+    if (!HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return tag_;
+}
+
+template <typename T>
+inline T& TagStorage<T>::GetComponent(Entity entity)
+{
+    if (!HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    return tag_;
+}
+
+template <typename T>
+inline void TagStorage<T>::RemoveComponent(Entity entity)
+{
+    if (!HasComponent(entity))
+    {
+        throw std::runtime_error("ComponentCollection: Entity does not have a component");
+    }
+
+    bits_.reset(GetEntityIndex(entity));
+}
+}  // namespace yecs
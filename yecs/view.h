@@ -0,0 +1,256 @@
+/****************************************************************************
+MIT License
+
+Copyright (c) 2019 Dmitry Kozlov (dmitry.a.kozlov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+****************************************************************************/
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "yecs/common.h"
+#include "yecs/component_storage.h"
+
+namespace yecs
+{
+/**
+ * @brief Typed view over entities having all of the given components.
+ *
+ * View joins several component storages: it walks the packed entity array of the smallest storage
+ * and looks up remaining components directly, so there is no intermediate EntitySet and every
+ * component is found with a single lookup per entity. Const-qualified component types are
+ * accessed read-only: View<Position, const Velocity> yields (Entity, Position&, const Velocity&).
+ *
+ * Tag components (see TagStorage) are tested for presence but never drive iteration.
+ *
+ * Views are cheap to copy. Adding or removing components of viewed types while iterating
+ * invalidates the view.
+ **/
+template <typename... ComponentTs>
+class View
+{
+    static_assert(sizeof...(ComponentTs) > 0, "View: at least one component type is required");
+
+public:
+    // Storage type (const-qualified for read-only components) for a component type.
+    template <typename ComponentT>
+    using StorageOf = std::conditional_t<std::is_const_v<ComponentT>,
+                                         const ComponentStorageType<std::remove_const_t<ComponentT>>,
+                                         ComponentStorageType<std::remove_const_t<ComponentT>>>;
+
+    // Tuple yielded by view iterators.
+    using value_type = std::tuple<Entity, ComponentTs&...>;
+
+    static_assert((IsIndexedStorage<std::remove_const_t<StorageOf<ComponentTs>>>::value || ...),
+                  "View: at least one component should have an indexed storage, tags can not drive iteration");
+
+    class iterator;
+
+    explicit View(StorageOf<ComponentTs>&... storages) noexcept;
+
+    /**
+     * @brief Call a function for each entity having all the components.
+     *
+     * @param f Function with the signature void(Entity, ComponentTs&...).
+     **/
+    template <typename F>
+    void ForEach(F&& f) const
+    {
+        ForEach(0, size_hint(), std::forward<F>(f));
+    }
+
+    /**
+     * @brief Call a function for each matching entity in a range of the driving storage.
+     *
+     * Allows to split iteration into independent chunks, [0, size_hint()) covers all the entities.
+     *
+     * @param begin First index in the driving storage.
+     * @param end Index past the last one in the driving storage.
+     * @param f Function with the signature void(Entity, ComponentTs&...).
+     **/
+    template <typename F>
+    void ForEach(size_t begin, size_t end, F&& f) const
+    {
+        ForEachImpl(begin, end, f, std::index_sequence_for<ComponentTs...>());
+    }
+
+    // Size of the driving (smallest) storage, upper bound of the number of entities in the view.
+    size_t size_hint() const { return size_hint_; }
+
+    // Iteration support.
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, size_hint_); }
+
+private:
+    using Storages   = std::tuple<StorageOf<ComponentTs>*...>;
+    using Components = std::tuple<ComponentTs*...>;
+
+    // True if storage I can drive iteration.
+    template <size_t I>
+    static constexpr bool kIndexed =
+        IsIndexedStorage<std::remove_const_t<std::remove_pointer_t<std::tuple_element_t<I, Storages>>>>::value;
+
+    template <typename F, size_t... I>
+    void ForEachImpl(size_t begin, size_t end, F& f, std::index_sequence<I...>) const
+    {
+        // Instantiate a loop for each possible driving storage, dispatch once.
+        ((driver_ == I ? Iterate<I>(begin, end, f, std::index_sequence<I...>()) : void()), ...);
+    }
+
+    template <size_t D, typename F, size_t... I>
+    void Iterate(size_t begin, size_t end, F& f, std::index_sequence<I...> indices) const
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            Entity     entity;
+            Components components;
+
+            if (FetchFrom<D>(i, entity, components, indices))
+            {
+                f(entity, *std::get<I>(components)...);
+            }
+        }
+    }
+
+    // Find the entity at index of the driving storage and its components, returns false if one is missing.
+    template <size_t... I>
+    bool Fetch(size_t index, Entity& entity, Components& components, std::index_sequence<I...> indices) const
+    {
+        bool found = false;
+        ((driver_ == I ? (void)(found = FetchFrom<I>(index, entity, components, indices)) : void()), ...);
+        return found;
+    }
+
+    // Same as above for a known driving storage D.
+    template <size_t D, size_t... I>
+    bool FetchFrom(size_t index, Entity& entity, Components& components, std::index_sequence<I...>) const
+    {
+        if constexpr (kIndexed<D>)
+        {
+            entity = std::get<D>(storages_)->entity(index);
+            return (((std::get<I>(components) = Access<I, D>(entity, index)) != nullptr) && ...);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Component of storage I, nullptr if missing. Component of the driving storage D is known by index.
+    // This is the only place accessing storages, new storage kinds only need to be handled here.
+    template <size_t I, size_t D>
+    auto Access(Entity entity, size_t index) const
+    {
+        if constexpr (I == D)
+        {
+            return &(*std::get<I>(storages_))[index];
+        }
+        else
+        {
+            return std::get<I>(storages_)->FindComponent(entity);
+        }
+    }
+
+    // Component storages.
+    Storages storages_;
+    // Index of the smallest storage driving iteration.
+    size_t driver_ = 0;
+    // Size of the driving storage.
+    size_t size_hint_ = 0;
+};
+
+/**
+ * @brief Forward iterator over a View yielding std::tuple<Entity, ComponentTs&...>.
+ **/
+template <typename... ComponentTs>
+class View<ComponentTs...>::iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = typename View::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = value_type;
+
+    iterator(const View* view, size_t index) : view_(view), index_(index) { Settle(); }
+
+    reference operator*() const { return Dereference(std::index_sequence_for<ComponentTs...>()); }
+
+    iterator& operator++()
+    {
+        ++index_;
+        Settle();
+        return *this;
+    }
+
+    iterator operator++(int)
+    {
+        auto copy = *this;
+        ++(*this);
+        return copy;
+    }
+
+    bool operator==(const iterator& rhs) const { return index_ == rhs.index_; }
+    bool operator!=(const iterator& rhs) const { return index_ != rhs.index_; }
+
+private:
+    // Skip entities missing some of the components.
+    void Settle()
+    {
+        while (index_ < view_->size_hint_ &&
+               !view_->Fetch(index_, entity_, components_, std::index_sequence_for<ComponentTs...>()))
+        {
+            ++index_;
+        }
+    }
+
+    template <size_t... I>
+    reference Dereference(std::index_sequence<I...>) const
+    {
+        return reference(entity_, *std::get<I>(components_)...);
+    }
+
+    const View*               view_;
+    size_t                    index_;
+    Entity                    entity_ = kInvalidEntity;
+    typename View::Components components_;
+};
+
+template <typename... ComponentTs>
+inline View<ComponentTs...>::View(StorageOf<ComponentTs>&... storages) noexcept : storages_(&storages...)
+{
+    // Tag storages never drive iteration.
+    size_t sizes[] = {(IsIndexedStorage<std::remove_const_t<StorageOf<ComponentTs>>>::value ? storages.size()
+                                                                                          : ~size_t(0))...};
+
+    for (auto i = 0u; i < sizeof...(ComponentTs); ++i)
+    {
+        if (sizes[i] < sizes[driver_])
+        {
+            driver_ = i;
+        }
+    }
+
+    size_hint_ = sizes[driver_];
+}
+}  // namespace yecs
@@ -1,51 +1,493 @@
 #include "world.h"
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
 namespace yecs
 {
+namespace
+{
+// Generates unique command buffer set ids, 0 is never used.
+uint64_t NextCommandBuffersId()
+{
+    static std::atomic<uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+}  // namespace
+
+World::World(const WorldConfig& config)
+    : resource_(config.memory_resource ? config.memory_resource : std::pmr::get_default_resource()),
+      entities_(resource_),
+      generations_(resource_),
+      entity_allocator_(config.entity_reuse_policy, resource_),
+      component_masks_(resource_),
+      component_ticks_(resource_),
+      archetypes_(resource_),
+      executor_(config.num_threads ? config.num_threads : std::thread::hardware_concurrency()),
+      frame_arena_block_size_(config.frame_arena_block_size),
+      command_buffers_id_(NextCommandBuffersId())
+{
+}
+
 void World::Run()
 {
-    executor_.run(taskflow_);
+    ++tick_;
+
+    // Transient data of the previous frame is released.
+    {
+        std::lock_guard<std::mutex> lock(frame_arena_mutex_);
+        for (auto& arena : frame_arenas_) { arena.second->Reset(); }
+    }
+
+    if (taskflow_dirty_)
+    {
+        BuildTaskflow();
+    }
+
+    executor_.run(*taskflow_);
     executor_.wait_for_all();
+
+    FlushCommands();
+}
+
+CommandBuffer& World::GetCommandBuffer()
+{
+    // Last buffer used by this thread, lookup is done under the lock only once per thread and buffer set.
+    thread_local uint64_t       cached_id     = 0;
+    thread_local CommandBuffer* cached_buffer = nullptr;
+
+    if (cached_id != command_buffers_id_)
+    {
+        std::lock_guard<std::mutex> lock(command_buffer_mutex_);
+
+        auto& buffer = command_buffers_[std::this_thread::get_id()];
+        if (!buffer)
+        {
+            buffer.reset(new CommandBuffer(entity_allocator_));
+        }
+
+        cached_id     = command_buffers_id_;
+        cached_buffer = buffer.get();
+    }
+
+    return *cached_buffer;
+}
+
+FrameArena& World::GetFrameArena()
+{
+    // Same caching as for command buffers.
+    thread_local uint64_t    cached_id    = 0;
+    thread_local FrameArena* cached_arena = nullptr;
+
+    if (cached_id != command_buffers_id_)
+    {
+        std::lock_guard<std::mutex> lock(frame_arena_mutex_);
+
+        auto& arena = frame_arenas_[std::this_thread::get_id()];
+        if (!arena)
+        {
+            arena.reset(new FrameArena(frame_arena_block_size_, resource_));
+        }
+
+        cached_id    = command_buffers_id_;
+        cached_arena = arena.get();
+    }
+
+    return *cached_arena;
+}
+
+void World::FlushCommands()
+{
+    std::lock_guard<std::mutex> command_buffer_lock(command_buffer_mutex_);
+
+    // Take all the commands out first, so buffers are empty even if playback throws.
+    std::vector<EntityIndex>            created;
+    std::vector<CommandBuffer::Command> commands;
+    std::vector<Entity>                 destroyed;
+
+    for (auto& buffer : command_buffers_)
+    {
+        buffer.second->num_created_ = buffer.second->created_.size();
+        created.insert(created.end(), buffer.second->created_.cbegin(), buffer.second->created_.cend());
+        destroyed.insert(destroyed.end(), buffer.second->destroyed_.cbegin(), buffer.second->destroyed_.cend());
+        std::move(buffer.second->commands_.begin(), buffer.second->commands_.end(), std::back_inserter(commands));
+
+        buffer.second->created_.clear();
+        buffer.second->commands_.clear();
+        buffer.second->destroyed_.clear();
+    }
+
+    std::lock_guard<std::mutex> component_lock(component_mutex_);
+    std::lock_guard<std::mutex> entity_lock(entity_mutex_);
+
+    // Entities are materialized at once, their indices have been reserved while recording.
+    if (!created.empty())
+    {
+        auto max_index = *std::max_element(created.cbegin(), created.cend());
+        if (max_index >= entities_.size())
+        {
+            entities_.resize((max_index / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+            generations_.resize(entities_.size(), 0);
+        }
+
+        for (auto index : created) { entities_.set(index); }
+    }
+
+    // Group component commands by storage, for a given storage apply commands in entity order.
+    // Stable sort keeps recording order of commands for the same component of the same entity.
+    std::stable_sort(commands.begin(), commands.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.component < rhs.component ||
+               (lhs.component == rhs.component && GetEntityIndex(lhs.entity) < GetEntityIndex(rhs.entity));
+    });
+
+    ComponentStorageBase* storage = nullptr;
+    size_t                bit     = kInvalidComponentBit;
+    for (auto i = 0u; i < commands.size(); ++i)
+    {
+        auto& command = commands[i];
+
+        if (i == 0 || command.component != commands[i - 1].component)
+        {
+            if (command.component >= components_.size() || !components_[command.component])
+            {
+                throw std::runtime_error("World: component type not registered");
+            }
+            storage = components_[command.component].get();
+            bit     = GetComponentBit(command.component);
+        }
+
+        if (!IsAlive(command.entity))
+        {
+            continue;
+        }
+
+        if (command.add)
+        {
+            auto added = !GetEntityMask(command.entity).test(bit);
+            command.add(*storage, command.entity, command.value.get());
+            UpdateEntityMask(command.entity, bit, true);
+            StampComponent(GetEntityIndex(command.entity), bit, added);
+        }
+        else if (GetEntityMask(command.entity).test(bit))
+        {
+            storage->RemoveComponent(command.entity);
+            UpdateEntityMask(command.entity, bit, false);
+        }
+    }
+
+    for (auto entity : destroyed)
+    {
+        if (IsAlive(entity))
+        {
+            DestroyEntityNoLock(entity);
+        }
+    }
+
+    // Hand destroyed slots over to buffers, so that entities they create next frame reuse them.
+    for (auto& buffer : command_buffers_)
+    {
+        auto& recycled = buffer.second->recycled_;
+        while (recycled.size() < buffer.second->num_created_)
+        {
+            auto index = entity_allocator_.AllocateFreed();
+            if (!index)
+            {
+                return;
+            }
+
+            recycled.push_back(MakeEntity(*index, generations_[*index]));
+        }
+    }
+}
+
+void World::BuildTaskflow()
+{
+    std::lock_guard<std::mutex> lock(system_mutex_);
+
+    taskflow_ = std::make_unique<tf::Taskflow>();
+
+    for (auto& invoke : systems_)
+    {
+        invoke.task = taskflow_->emplace([system = invoke.system.get(), this](tf::Subflow& subflow) {
+            ComponentAccess access(*this);
+            EntityQuery     query(*this);
+            system->Run(access, query, subflow);
+        });
+    }
+
+    // Precedence graph over registration order indices.
+    std::vector<std::vector<size_t>> successors(systems_.size());
+
+    auto add_edge = [this, &successors](size_t from, size_t to) {
+        successors[from].push_back(to);
+        systems_[from].task.precede(systems_[to].task);
+    };
+
+    auto reachable = [&successors](size_t from, size_t to) {
+        std::vector<size_t> stack{from};
+        std::vector<bool>   visited(successors.size(), false);
+        while (!stack.empty())
+        {
+            auto node = stack.back();
+            stack.pop_back();
+            if (node == to)
+            {
+                return true;
+            }
+            if (!visited[node])
+            {
+                visited[node] = true;
+                stack.insert(stack.end(), successors[node].cbegin(), successors[node].cend());
+            }
+        }
+        return false;
+    };
+
+    auto intersects = [](const ComponentTypes& lhs, const ComponentTypes& rhs) {
+        return std::find_first_of(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend()) != lhs.cend();
+    };
+
+    auto conflicts = [&intersects](const SystemInvoke& lhs, const SystemInvoke& rhs) {
+        return lhs.declared && rhs.declared &&
+               (intersects(lhs.writes, rhs.writes) || intersects(lhs.writes, rhs.reads) ||
+                intersects(lhs.reads, rhs.writes));
+    };
+
+    // Explicit precedence goes first.
+    for (auto& precedence : precedence_)
+    {
+        add_edge(precedence.first, precedence.second);
+    }
+
+    // Conflicting systems are ordered by registration unless they are already ordered either way.
+    for (size_t later = 0; later < systems_.size(); ++later)
+    {
+        for (size_t earlier = 0; earlier < later; ++earlier)
+        {
+            if (conflicts(systems_[earlier], systems_[later]) && !reachable(earlier, later) &&
+                !reachable(later, earlier))
+            {
+                add_edge(earlier, later);
+            }
+        }
+    }
+
+    taskflow_dirty_ = false;
+}
+
+void World::UpdateEntityMask(Entity entity, size_t bit, bool value)
+{
+    auto index = GetEntityIndex(entity);
+
+    if (index >= component_masks_.size())
+    {
+        component_masks_.resize((index / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+    }
+
+    if (queries_.empty())
+    {
+        component_masks_[index].set(bit, value);
+        return;
+    }
+
+    auto before = component_masks_[index];
+    component_masks_[index].set(bit, value);
+    UpdateQueries(entity, before, component_masks_[index]);
+}
+
+const CachedQuery& World::RegisterQuery(const ComponentMask& mask)
+{
+    std::lock_guard<std::mutex> component_lock(component_mutex_);
+    std::lock_guard<std::mutex> entity_lock(entity_mutex_);
+
+    for (auto& query : queries_)
+    {
+        if (query->mask() == mask)
+        {
+            return *query;
+        }
+    }
+
+    // Match existing entities once, afterwards the query is updated along with component masks.
+    auto query = std::make_unique<CachedQuery>(mask, resource_);
+    entities_.ForEach([this, &query](EntityIndex i) {
+        if (i < component_masks_.size() && query->Matches(component_masks_[i]))
+        {
+            query->entities_.Insert(MakeEntity(i, generations_[i]));
+        }
+    });
+
+    queries_.push_back(std::move(query));
+    return *queries_.back();
+}
+
+void World::StampComponent(EntityIndex index, size_t bit, bool added)
+{
+    auto& ticks = component_ticks_[bit];
+
+    if (index >= ticks.size())
+    {
+        ticks.resize((index / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+    }
+
+    ticks[index].changed = tick_;
+    if (added)
+    {
+        ticks[index].added = tick_;
+    }
 }
 
 void World::Reset()
 {
     entities_.clear();
+    generations_.clear();
+    entity_allocator_.Reset();
     components_.clear();
+    component_bits_.clear();
+    storages_.clear();
+    archetype_components_.reset();
+    component_masks_.clear();
+    component_ticks_.clear();
+    tick_ = 0;
+    queries_.clear();
+    archetypes_.Reset();
     systems_.clear();
+    system_indices_.clear();
+    precedence_.clear();
+    taskflow_.reset();
+    taskflow_dirty_ = true;
+    command_buffers_.clear();
+    frame_arenas_.clear();
+    command_buffers_id_ = NextCommandBuffersId();
+}
+
+bool World::IsAlive(Entity entity) const noexcept
+{
+    auto index = GetEntityIndex(entity);
+    return index < entities_.size() && entities_.test(index) && generations_[index] == GetEntityGeneration(entity);
 }
 
 World::EntityBuilder World::CreateEntity()
 {
     std::lock_guard<std::mutex> lock(entity_mutex_);
 
-    auto id = kInvalidEntity;
+    auto index = entity_allocator_.Allocate();
 
-    // Look for free entity in an existing array.
-    for (size_t i = 0; i < entities_.size(); ++i)
+    // If entity array is full, extend it.
+    if (index >= entities_.size())
     {
-        if (!entities_[i])
+        // Indices reserved by command buffers might not be materialized yet, so index can be past the next block.
+        entities_.resize((index / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+        generations_.resize(entities_.size(), 0);
+    }
+
+    // Mark entity as existing.
+    entities_.set(index);
+    return EntityBuilder(MakeEntity(index, generations_[index]), *this);
+}
+
+EntityRange World::CreateEntities(size_t count, Entity source)
+{
+    std::lock_guard<std::mutex> component_lock(component_mutex_);
+    std::lock_guard<std::mutex> entity_lock(entity_mutex_);
+
+    if (!IsAlive(source))
+    {
+        throw std::runtime_error("World: entity does not exist");
+    }
+
+    if (count == 0)
+    {
+        return EntityRange();
+    }
+
+    auto          mask     = GetEntityMask(source);
+    auto          entities = CreateEntitiesNoLock(count, mask);
+    ComponentMask cloned;
+
+    try
+    {
+        // Archetype components are copied into the source archetype at once.
+        archetypes_.CloneEntity(source, entities);
+        cloned = mask & archetype_components_;
+
+        for (auto bit = 0u; bit < storages_.size(); ++bit)
+        {
+            if (mask.test(bit) && !archetype_components_.test(bit))
+            {
+                storages_[bit]->CloneComponent(source, entities);
+                cloned.set(bit);
+            }
+        }
+    }
+    catch (...)
+    {
+        // Do not leave half-built entities behind.
+        for (auto entity : entities)
         {
-            id = static_cast<Entity>(i);
-            break;
+            UpdateQueries(entity, mask, cloned);
+            component_masks_[GetEntityIndex(entity)] = cloned;
+            DestroyEntityNoLock(entity);
         }
+        throw;
     }
 
-    // If it is full, resize and add new entities.
-    if (id == kInvalidEntity)
+    return entities;
+}
+
+EntityRange World::CreateEntitiesNoLock(size_t count, const ComponentMask& mask)
+{
+    auto first = entity_allocator_.Allocate(count);
+    auto end   = static_cast<size_t>(first) + count;
+
+    if (end > entities_.size())
     {
-        // Add one entity at the end.
-        auto old_size = entities_.size();
-        id            = static_cast<Entity>(old_size);
+        entities_.resize((end / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+        generations_.resize(entities_.size(), 0);
+    }
 
-        // Set added elements to false (no entity).
-        entities_.resize(old_size + kEntitySizeIncrement);
-        std::fill(entities_.begin() + old_size, entities_.end(), false);
+    if (end > component_masks_.size())
+    {
+        component_masks_.resize((end / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
     }
 
-    // Mark entity as existing.
-    entities_[id] = true;
-    return EntityBuilder(id, *this);
+    // Entities of a range share a generation, slots of a reused range are raised to the newest one,
+    // which keeps stale handles dead. Fresh indices have never been used, so their generation is 0.
+    auto generation = *std::max_element(generations_.begin() + first, generations_.begin() + end);
+    for (auto index = first; index < end; ++index)
+    {
+        entities_.set(index);
+        generations_[index]     = generation;
+        component_masks_[index] = mask;
+    }
+
+    auto entities = EntityRange(first, count, generation);
+
+    for (auto& query : queries_)
+    {
+        if (query->Matches(mask))
+        {
+            query->Insert(entities);
+        }
+    }
+
+    // Every component of the batch is added at the current tick.
+    for (size_t bit = 0; bit < storages_.size(); ++bit)
+    {
+        if (mask.test(bit))
+        {
+            auto& ticks = component_ticks_[bit];
+            if (end > ticks.size())
+            {
+                ticks.resize((end / kEntitySizeIncrement + 1) * kEntitySizeIncrement);
+            }
+
+            std::fill(ticks.begin() + first, ticks.begin() + end, ComponentTicks{tick_, tick_});
+        }
+    }
+
+    return entities;
 }
 
 void World::DestroyEntity(Entity entity)
@@ -53,14 +495,127 @@ void World::DestroyEntity(Entity entity)
     std::lock_guard<std::mutex> component_lock(component_mutex_);
     std::lock_guard<std::mutex> entity_lock(entity_mutex_);
 
-    for (auto& components : components_)
+    if (!IsAlive(entity))
+    {
+        throw std::runtime_error("World: entity does not exist");
+    }
+
+    DestroyEntityNoLock(entity);
+}
+
+void World::DestroyEntities(const Entity* entities, size_t count)
+{
+    std::lock_guard<std::mutex> component_lock(component_mutex_);
+    std::lock_guard<std::mutex> entity_lock(entity_mutex_);
+
+    // Validate the whole batch first, clearing entity bits on the way catches repeated entities too.
+    for (auto i = 0u; i < count; ++i)
+    {
+        if (!IsAlive(entities[i]))
+        {
+            for (auto j = 0u; j < i; ++j) { entities_.set(GetEntityIndex(entities[j])); }
+            throw std::runtime_error("World: entity does not exist");
+        }
+
+        entities_.reset(GetEntityIndex(entities[i]));
+    }
+
+    // Group entities by storage, archetype components are removed at once per entity.
+    std::vector<std::vector<Entity>> removed(storages_.size());
+    // Reusable slots, returned to the allocator in ascending order.
+    EntityBitset released;
+    released.resize(entities_.size());
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto entity = entities[i];
+        auto index  = GetEntityIndex(entity);
+
+        archetypes_.DestroyEntity(entity);
+
+        if (index < component_masks_.size())
+        {
+            auto mask = component_masks_[index] & ~archetype_components_;
+            for (size_t bit = 0; bit < storages_.size() && mask.any(); ++bit)
+            {
+                if (mask.test(bit))
+                {
+                    removed[bit].push_back(entity);
+                    mask.reset(bit);
+                }
+            }
+
+            UpdateQueries(entity, component_masks_[index], ComponentMask());
+            component_masks_[index].reset();
+        }
+
+        if (AdvanceGenerationNoLock(index))
+        {
+            released.set(index);
+        }
+    }
+
+    // Runs of consecutive indices can be reused by CreateEntities as a whole.
+    std::vector<EntityIndex> indices;
+    indices.reserve(released.count());
+    released.ForEach([&indices](EntityIndex index) { indices.push_back(index); });
+    entity_allocator_.Free(indices.data(), indices.size());
+
+    for (auto bit = 0u; bit < storages_.size(); ++bit)
     {
-        if (components.second->HasComponent(entity))
+        if (!removed[bit].empty())
         {
-            components.second->RemoveComponent(entity);
+            storages_[bit]->RemoveComponents(removed[bit].data(), removed[bit].size());
         }
     }
+}
+
+void World::DestroyEntityNoLock(Entity entity)
+{
+    // Archetype components are removed at once rather than migrating entity once per component.
+    archetypes_.DestroyEntity(entity);
+
+    auto index = GetEntityIndex(entity);
+
+    // Only visit storages entity has components in.
+    if (index < component_masks_.size())
+    {
+        auto mask = component_masks_[index] & ~archetype_components_;
+        for (size_t bit = 0; bit < storages_.size() && mask.any(); ++bit)
+        {
+            if (mask.test(bit))
+            {
+                storages_[bit]->RemoveComponent(entity);
+                mask.reset(bit);
+            }
+        }
+
+        UpdateQueries(entity, component_masks_[index], ComponentMask());
+        component_masks_[index].reset();
+    }
+
+    ReleaseEntityNoLock(index);
+}
+
+void World::ReleaseEntityNoLock(EntityIndex index)
+{
+    entities_.reset(index);
+
+    if (AdvanceGenerationNoLock(index))
+    {
+        entity_allocator_.Free(index);
+    }
+}
+
+bool World::AdvanceGenerationNoLock(EntityIndex index)
+{
+    // Retire the slot once its generation is exhausted, so stale handles never alias new entities.
+    if (generations_[index] < kMaxEntityGeneration)
+    {
+        ++generations_[index];
+        return true;
+    }
 
-    entities_[entity] = false;
+    return false;
 }
-}  // namespace yecs
\ No newline at end of file
+}  // namespace yecs
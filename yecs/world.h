@@ -25,10 +25,15 @@ SOFTWARE.
 
 #include <cassert>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <new>
 #include <stdexcept>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 // Disable warning as error for VS2019 build, taskflow has mutliple type conversion producing warning.
@@ -42,15 +47,49 @@ SOFTWARE.
 #pragma warning(pop)
 #endif
 
+#include "yecs/archetype.h"
+#include "yecs/cached_query.h"
+#include "yecs/command_buffer.h"
 #include "yecs/common.h"
 #include "yecs/component_storage.h"
 #include "yecs/component_types_builder.h"
+#include "yecs/entity_allocator.h"
+#include "yecs/entity_bitset.h"
 #include "yecs/entity_query.h"
 #include "yecs/entity_set.h"
+#include "yecs/frame_arena.h"
+#include "yecs/parallel.h"
 #include "yecs/system.h"
+#include "yecs/tag_storage.h"
+#include "yecs/view.h"
 
 namespace yecs
 {
+namespace detail
+{
+// Storage of a query component, const-qualified components are accessed through a const storage.
+template <typename ComponentT>
+using QueryStorageRef = std::conditional_t<std::is_const_v<ComponentT>,
+                                           const ComponentStorageType<std::remove_const_t<ComponentT>>&,
+                                           ComponentStorageType<std::remove_const_t<ComponentT>>&>;
+}  // namespace detail
+
+/**
+ * @brief World construction parameters.
+ **/
+struct WorldConfig
+{
+    // Order in which ids of entities destroyed one by one are reused, see EntityReusePolicy.
+    EntityReusePolicy entity_reuse_policy = EntityReusePolicy::kLifo;
+    // Number of executor worker threads, 0 means std::thread::hardware_concurrency().
+    unsigned num_threads = 0;
+    // Size of the first block of per-thread frame arenas.
+    size_t frame_arena_block_size = FrameArena::kDefaultBlockSize;
+    // Resource component storages, entity tables and query results are allocated from, nullptr means
+    // std::pmr::get_default_resource(). The resource should outlive the world.
+    std::pmr::memory_resource* memory_resource = nullptr;
+};
+
 /**
  * @brief Provides primary ECS interface for clients.
  *
@@ -77,9 +116,9 @@ public:
         EntityBuilder(EntityBuilder&) = delete;
         EntityBuilder& operator=(EntityBuilder&) = delete;
 
-        // Add component of a given type.
-        template <typename ComponentT>
-        EntityBuilder& AddComponent();
+        // Add component of a given type constructed from args (value-initialized if there are none).
+        template <typename ComponentT, typename... Args>
+        EntityBuilder& AddComponent(Args&&... args);
 
         // Build entity (return its id).
         Entity Build() const noexcept { return entity_; }
@@ -97,7 +136,7 @@ public:
     };
 
 public:
-    World()  = default;
+    explicit World(const WorldConfig& config = WorldConfig());
     ~World() = default;
 
     /**
@@ -105,11 +144,18 @@ public:
      *
      * An attempt to add a component of unregistered type to an entity leads to an exception being thrown.
      *
+     * Storage type is ComponentStorageType<ComponentT>: registration, command buffers, views and queries all
+     * find the storage through ComponentStorageTraits, specialize the traits to select a different storage.
+     *
+     * Storages taking a std::pmr::memory_resource* in their constructor allocate components from resource or
+     * from the world resource (WorldConfig::memory_resource) if resource is nullptr. Archetype components
+     * share chunks allocated from the world resource.
+     *
      * @tparam ComponentT The type of a component.
-     * @tparam StorageT Optional component storage type.
+     * @param resource Optional memory resource of the storage, should outlive the world.
      **/
-    template <typename ComponentT, typename StorageT = DenseComponentStorage<ComponentT>>
-    void RegisterComponent();
+    template <typename ComponentT>
+    void RegisterComponent(std::pmr::memory_resource* resource = nullptr);
 
     /**
      * @brief Register a system.
@@ -119,6 +165,11 @@ public:
      * Systems are indexed by their type, meaning it is not possible to have two systems of the same type
      * in the World.
      *
+     * If SystemT declares component access (SystemT::Reads and/or SystemT::Writes type lists), World orders
+     * it after each previously registered declaring system it conflicts with (one of them writes a component
+     * the other one accesses), unless Precede forces the opposite order. Systems only reading the same
+     * components run concurrently. Systems without declarations are ordered by Precede only.
+     *
      * @tparam SystemT The type of a system.
      * @tparam Args Constructor argument types.
      *
@@ -131,7 +182,7 @@ public:
      * @brief Make one system to run before another one.
      *
      * By default systems can execute in arbitrary order (or even in parallel). Precede sets an order of system
-     * execution.
+     * execution, overriding the order inferred from declared component access.
      *
      * @tparam SystemT0 The system to execute before SystemT1.
      * @tparam SystemT1 The system to execute after SystemT0.
@@ -149,15 +200,77 @@ public:
      **/
     EntityBuilder CreateEntity();
 
+    /**
+     * @brief Create a batch of entities having the same components.
+     *
+     * Entity indices, component masks and storage capacity are allocated once for the whole batch and
+     * every prototype component is copied into its storage in bulk. New entities take consecutive indices,
+     * the lowest run of destroyed indices long enough for the batch is reused, otherwise fresh indices are
+     * appended. Entities of a batch share a generation: slots of a reused run are raised to the newest
+     * generation among them, so stale handles to any of them stay dead:
+     * auto bullets = world.CreateEntities(100000, Position{}, Velocity{0.f, 0.f, 1.f});
+     *
+     * @tparam ComponentTs Prototype component types.
+     * @param count Number of entities to create, empty range is returned for 0.
+     * @param prototype Values of components to copy into every entity.
+     *
+     * @return Range of created entities.
+     * @throw std::runtime_error if any of the component types is not registered.
+     **/
+    template <typename... ComponentTs>
+    EntityRange CreateEntities(size_t count, const ComponentTs&... prototype);
+
+    /**
+     * @brief Create a batch of copies of an existing entity.
+     *
+     * Works like the prototype version of CreateEntities, but copies every component of source entity.
+     *
+     * @param count Number of entities to create, empty range is returned for 0.
+     * @param source Entity to copy components from.
+     *
+     * @return Range of created entities.
+     * @throw std::runtime_error if source does not exist or any of its components is not copy constructible.
+     **/
+    EntityRange CreateEntities(size_t count, Entity source);
+
     /**
      * @brief Destroy an entity.
      *
-     * Destroys an entity along with its components.
+     * Destroys an entity along with its components. Generation of entity slot is incremented and the slot is
+     * returned to the free list to be reused by subsequent CreateEntity calls according to
+     * WorldConfig::entity_reuse_policy. Slots whose generation wraps around are retired.
      *
      * @param entity Entity to destroy,
+     * @throw std::runtime_error if entity does not exist.
      **/
     void DestroyEntity(Entity entity);
 
+    /**
+     * @brief Destroy a batch of entities.
+     *
+     * Works like calling DestroyEntity for every entity, but locks are taken once, components are grouped
+     * by storage and every storage removes its batch compacting itself in one pass. Released slots are kept
+     * as index ranges for CreateEntities, CreateEntity reuses them after slots destroyed one by one
+     * regardless of WorldConfig::entity_reuse_policy.
+     *
+     * @param entities Entities to destroy.
+     * @param count Number of entities.
+     * @throw std::runtime_error if any of the entities does not exist or repeats, nothing is destroyed then.
+     **/
+    void DestroyEntities(const Entity* entities, size_t count);
+    void DestroyEntities(const std::vector<Entity>& entities) { DestroyEntities(entities.data(), entities.size()); }
+
+    /**
+     * @brief Check if entity handle refers to an existing entity.
+     *
+     * Handles of destroyed entities are never alive, even if their slot has been reused by another entity.
+     *
+     * @param entity Entity handle to check.
+     *
+     * @return true if entity exists, false otherwise.
+     **/
+    bool IsAlive(Entity entity) const noexcept;
+
     /**
      * @brief Add component to an entity.
      *
@@ -167,11 +280,43 @@ public:
      * @tparam ComponentT Component type to add.
      * @param entity Entity to add ComponentT component to.
      *
-     * @return Ref to a component.
+     * @return Ref to a component (proxy reference for storages not storing component objects).
      * @throw std::runtime_error
      **/
     template <typename ComponentT>
-    ComponentT& AddComponent(Entity entity);
+    decltype(auto) AddComponent(Entity entity);
+
+    /**
+     * @brief Add component to an entity constructing it in place.
+     *
+     * Works like AddComponent, but the component is constructed from args directly in its storage, so
+     * components do not have to be default constructible and prebuilt values are moved in:
+     * world.EmplaceComponent<Mesh>(entity, std::move(vertices), material).
+     *
+     * @tparam ComponentT Component type to add.
+     * @tparam Args Constructor argument types.
+     * @param entity Entity to add ComponentT component to.
+     * @param args Constructor arguments.
+     *
+     * @return Ref to a component (proxy reference for storages not storing component objects).
+     * @throw std::runtime_error
+     **/
+    template <typename ComponentT, typename... Args>
+    decltype(auto) EmplaceComponent(Entity entity, Args&&... args);
+
+    /**
+     * @brief Remove component from an entity.
+     *
+     * A type should be registered in the World and an entity should have ComponentT component,
+     * otherwise std::runtime_error is being thrown.
+     *
+     * @tparam ComponentT Component type to remove.
+     * @param entity Entity to remove ComponentT component from.
+     *
+     * @throw std::runtime_error
+     **/
+    template <typename ComponentT>
+    void RemoveComponent(Entity entity);
 
     /**
      * @brief Get ref to a component of a given type.
@@ -182,12 +327,12 @@ public:
      * @tparam ComponentT Component type.
      * @param entity Entity to get a component for.
      *
-     * @return Ref to a component.
+     * @return Ref to a component (proxy reference for storages not storing component objects).
      * @throw std::runtime_error
      **/
     // Get component for an entity.
     template <typename ComponentT>
-    ComponentT& GetComponent(Entity entity);
+    decltype(auto) GetComponent(Entity entity);
 
     /**
      * @brief Check if an entity has a component of a given type.
@@ -229,7 +374,7 @@ public:
      * @throw std::runtime_error
      **/
     template <typename ComponentT>
-    ComponentT& GetComponentByIndex(ComponentIndex index);
+    decltype(auto) GetComponentByIndex(ComponentIndex index);
 
     /**
      * @brief Get a const ref to a component given its index.
@@ -243,7 +388,7 @@ public:
      * @throw std::runtime_error
      **/
     template <typename ComponentT>
-    const ComponentT& GetComponentByIndex(ComponentIndex index) const;
+    decltype(auto) GetComponentByIndex(ComponentIndex index) const;
 
     /**
      * @brief Run one step of a simulation.
@@ -257,6 +402,58 @@ public:
      **/
     void Run();
 
+    /**
+     * @brief Get current world tick.
+     *
+     * Tick is incremented at the beginning of every Run, components added or changed during a step are
+     * stamped with its tick (see EntityQuery::Changed and EntityQuery::Added).
+     *
+     * @return Current tick.
+     **/
+    Tick GetTick() const noexcept { return tick_; }
+
+    // Resource component storages, entity tables and query results are allocated from (see WorldConfig).
+    std::pmr::memory_resource* GetMemoryResource() const noexcept { return resource_; }
+
+    /**
+     * @brief Mark a component of an entity as changed at the current tick.
+     *
+     * Components written through storages or views are not tracked, systems updating them should mark
+     * them explicitly. Marking different entities from parallel tasks is safe.
+     *
+     * @tparam ComponentT Component type.
+     * @param entity Entity having ComponentT component.
+     *
+     * @throw std::runtime_error if entity does not have ComponentT component.
+     **/
+    template <typename ComponentT>
+    void MarkChanged(Entity entity);
+
+    /**
+     * @brief Register a cached query over entities having all of the given components.
+     *
+     * Matching entities are collected once, afterwards World updates the query whenever components are added
+     * or removed and entities are created or destroyed, so systems iterating it pay no matching cost per frame.
+     * Queries are registered by signature: registering the same set of components again returns the same
+     * query. Queries live until the World is reset.
+     *
+     * @tparam ComponentTs Component types, should be registered in the world.
+     * @return Reference to the query.
+     * @throw std::runtime_error if a component type is not registered.
+     **/
+    template <typename... ComponentTs>
+    const CachedQuery& RegisterQuery();
+
+    /**
+     * @brief Play back commands recorded into command buffers.
+     *
+     * Run calls this automatically once all systems have finished, it can also be called between Run calls
+     * to apply commands at other sync points. Should not be called while Run is executing.
+     *
+     * @throw std::runtime_error if a command refers to a component type not registered in the World.
+     **/
+    void FlushCommands();
+
     /**
      * @brief Wipe out all the component and systems, return World to its initial state as if nothing
      * has been registered and executed.
@@ -272,8 +469,10 @@ public:
 private:
     // Get reference to a component storage of a specified type.
     // If type is not registered, throws std::runtime_error.
-    template <typename ComponentT, typename StorageT = DenseComponentStorage<ComponentT>>
-    StorageT& GetComponentStorage();
+    template <typename ComponentT>
+    ComponentStorageType<ComponentT>& GetComponentStorage();
+    template <typename ComponentT>
+    const ComponentStorageType<ComponentT>& GetComponentStorage() const;
 
     // Each time entity space is out, we extend an array by this number of elements.
     static constexpr uint32_t kEntitySizeIncrement = 128;
@@ -283,24 +482,140 @@ private:
     {
         tf::Task                task;
         std::unique_ptr<System> system;
+        // True if system declares component access.
+        bool declared = false;
+        // Declared component access.
+        ComponentTypes reads;
+        ComponentTypes writes;
     };
 
-    using ComponentsMap = std::unordered_map<std::type_index, std::unique_ptr<ComponentStorageBase>>;
-    using SystemsMap    = std::unordered_map<std::type_index, SystemInvoke>;
+    // Rebuild the task graph from registered systems, explicit and inferred precedence.
+    void BuildTaskflow();
 
-    // Entity array: true if entity exists, false if not.
-    std::mutex        entity_mutex_;
-    std::vector<bool> entities_;
-    // Component arrays.
-    std::mutex    component_mutex_;
-    ComponentsMap components_;
-    // Systems.
-    std::mutex system_mutex_;
-    SystemsMap systems_;
+    // Get command buffer of the calling thread.
+    CommandBuffer& GetCommandBuffer();
+
+    // Get frame arena of the calling thread.
+    FrameArena& GetFrameArena();
+
+    // Destroy an alive entity, caller should hold component and entity locks.
+    void DestroyEntityNoLock(Entity entity);
+
+    // Return a slot of a destroyed entity to the allocator, caller should hold entity lock.
+    void ReleaseEntityNoLock(EntityIndex index);
+
+    // Bump the generation of a destroyed entity slot, returns false if the slot is retired instead.
+    bool AdvanceGenerationNoLock(EntityIndex index);
+
+    // Allocate a range of fresh entities and set their component masks, caller should hold component and entity locks.
+    EntityRange CreateEntitiesNoLock(size_t count, const ComponentMask& mask);
+
+    // Create component storage, storages constructible from ArchetypeTable& are bound to the world table,
+    // storages constructible from std::pmr::memory_resource* allocate from resource.
+    template <typename StorageT>
+    std::unique_ptr<StorageT> CreateComponentStorage(std::pmr::memory_resource* resource);
+
+    // World-local bit of a component type or kInvalidComponentBit if type is not registered.
+    size_t GetComponentBit(TypeId id) const
+    {
+        return id < component_bits_.size() ? component_bits_[id] : kInvalidComponentBit;
+    }
+
+    // Mask of component types, throws std::runtime_error if any of the types is not registered.
+    template <typename... ComponentTs>
+    ComponentMask GetComponentMask() const;
+
+    // Component mask of an entity.
+    ComponentMask GetEntityMask(Entity entity) const
+    {
+        auto index = GetEntityIndex(entity);
+        return index < component_masks_.size() ? component_masks_[index] : ComponentMask();
+    }
 
-    // Task flow stuff.
-    tf::Taskflow taskflow_;
-    tf::Executor executor_;
+    // Set or clear a component bit of an entity, caller should hold component lock.
+    void UpdateEntityMask(Entity entity, size_t bit, bool value);
+
+    // Find or create a cached query for a component mask.
+    const CachedQuery& RegisterQuery(const ComponentMask& mask);
+
+    // Update cached queries when component mask of an entity changes, caller should hold component lock.
+    void UpdateQueries(Entity entity, const ComponentMask& before, const ComponentMask& after)
+    {
+        for (auto& query : queries_) { query->Update(entity, before, after); }
+    }
+
+    // Stamp a component of an entity as changed (and added if added is true), caller should hold component lock.
+    void StampComponent(EntityIndex index, size_t bit, bool added);
+
+    // Change stamps of a component.
+    struct ComponentTicks
+    {
+        // Tick component has been added at.
+        Tick added = 0;
+        // Tick component has been changed at last.
+        Tick changed = 0;
+    };
+
+    // Index of a system in systems_ or kInvalidSystemIndex if system is not registered.
+    size_t GetSystemIndex(TypeId id) const
+    {
+        return id < system_indices_.size() ? system_indices_[id] : kInvalidSystemIndex;
+    }
+
+    static constexpr size_t kInvalidSystemIndex = ~size_t(0);
+
+    // Component storages indexed by component type id, nullptr for types not registered.
+    using ComponentsArray = std::vector<std::unique_ptr<ComponentStorageBase>>;
+
+    // Resource of storages, tables and query results.
+    std::pmr::memory_resource* resource_;
+    // Entity table: bit is set if entity exists.
+    std::mutex   entity_mutex_;
+    EntityBitset entities_;
+    // Current generation of each entity slot.
+    std::pmr::vector<EntityGeneration> generations_;
+    EntityAllocator                    entity_allocator_;
+    // Component arrays.
+    std::mutex      component_mutex_;
+    ComponentsArray components_;
+    // World-local component bits indexed by component type id.
+    std::vector<size_t> component_bits_;
+    // Component storages indexed by component bit.
+    std::vector<ComponentStorageBase*> storages_;
+    // Bits of components stored in archetypes.
+    ComponentMask archetype_components_;
+    // Component masks indexed by entity index, kept in sync by World::AddComponent/RemoveComponent.
+    std::pmr::vector<ComponentMask> component_masks_;
+    // Change stamps indexed by component bit and entity index.
+    std::pmr::vector<std::pmr::vector<ComponentTicks>> component_ticks_;
+    // Current tick.
+    Tick tick_ = 0;
+    // Cached queries, guarded by component lock.
+    std::vector<std::unique_ptr<CachedQuery>> queries_;
+    // Components registered with ArchetypeComponentStorage.
+    ArchetypeTable archetypes_;
+    // Systems in registration order.
+    std::mutex                system_mutex_;
+    std::vector<SystemInvoke> systems_;
+    // Indices into systems_ indexed by system type id.
+    std::vector<size_t> system_indices_;
+    // Explicit precedence set by Precede, pairs of indices into systems_.
+    std::vector<std::pair<size_t, size_t>> precedence_;
+
+    // Task flow stuff, task graph is rebuilt lazily once systems or precedence change.
+    std::unique_ptr<tf::Taskflow> taskflow_;
+    bool                          taskflow_dirty_ = true;
+    tf::Executor                  executor_;
+
+    // Per-thread command buffers.
+    std::mutex                                                         command_buffer_mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<CommandBuffer>> command_buffers_;
+    // Per-thread frame arenas, reset at the start of Run.
+    std::mutex                                                        frame_arena_mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<FrameArena>> frame_arenas_;
+    size_t                                                            frame_arena_block_size_;
+    // Unique id of command buffer and frame arena sets, used to validate per-thread caches.
+    uint64_t command_buffers_id_ = 0;
 
     friend class EntityQuery;
     friend class ComponentAccess;
@@ -318,24 +633,102 @@ public:
     /**
      * @brief Request component storage for write access.
      *
+     * Components should not be added or removed through the storage directly, since World tracks
+     * component masks of entities, use command buffers instead (see Commands).
+     *
      * @tparam ComponentT The type of the component needed.
-     * @tparam StorageT Optional storage type.
      *
      * @return Reference to component storage.
      **/
-    template <typename ComponentT, typename StorageT = DenseComponentStorage<ComponentT>>
-    StorageT& Write();
+    template <typename ComponentT>
+    ComponentStorageType<ComponentT>& Write();
 
     /**
      * @brief Request component storage for read access.
      *
      * @tparam ComponentT The type of the component needed.
-     * @tparam StorageT Optional storage type.
      *
      * @return Const reference to component storage.
      **/
-    template <typename ComponentT, typename StorageT = DenseComponentStorage<ComponentT>>
-    const StorageT& Read() const;
+    template <typename ComponentT>
+    const ComponentStorageType<ComponentT>& Read() const;
+
+    /**
+     * @brief Request a view over entities having all of the given components.
+     *
+     * Non-const component types are accessed for write, const-qualified ones for read:
+     * View<Position, const Velocity>() yields (Entity, Position&, const Velocity&) tuples.
+     *
+     * @tparam ComponentTs The types of the components needed.
+     *
+     * @return View joining component storages.
+     **/
+    template <typename... ComponentTs>
+    yecs::View<ComponentTs...> View();
+
+    /**
+     * @brief Request a view over entities having all of the given components stored in archetypes.
+     *
+     * All the components should be registered with ArchetypeComponentStorage. Matching archetypes
+     * are iterated chunk by chunk.
+     *
+     * @tparam ComponentTs The types of the components needed, const-qualified for read access.
+     *
+     * @return View over archetype chunks.
+     **/
+    template <typename... ComponentTs>
+    yecs::ArchetypeView<ComponentTs...> ArchetypeView() const;
+
+    /**
+     * @brief Request command buffer of the calling thread.
+     *
+     * Structural changes (creating and destroying entities, adding and removing components) made from
+     * systems should be recorded into a command buffer, they are applied once World::Run finishes.
+     * Subflow tasks outlive the Run call of a system, so they should capture ComponentAccess by value
+     * and request the buffer when executed, since it might run on a different thread.
+     *
+     * @return Reference to command buffer.
+     **/
+    CommandBuffer& Commands() { return world_.GetCommandBuffer(); }
+
+    /**
+     * @brief Request frame arena of the calling thread.
+     *
+     * The arena is a std::pmr::memory_resource for scratch data of a system, such as
+     * std::pmr::vector<Entity> buffer(&access.FrameArena()). Memory is reclaimed at the start of the
+     * next World::Run, so it should not be kept past that. Like command buffers, the arena should be
+     * requested by subflow tasks when executed.
+     *
+     * @return Reference to the arena.
+     **/
+    yecs::FrameArena& FrameArena() { return world_.GetFrameArena(); }
+
+    /**
+     * @brief Request a component of an entity for write access.
+     *
+     * Unlike writes through a storage or a view, the component is marked as changed at the current tick.
+     *
+     * @tparam ComponentT The type of the component needed.
+     *
+     * @return Reference to the component.
+     * @throw std::runtime_error if entity does not have ComponentT component.
+     **/
+    template <typename ComponentT>
+    decltype(auto) Write(Entity entity)
+    {
+        world_.MarkChanged<ComponentT>(entity);
+        return world_.GetComponent<ComponentT>(entity);
+    }
+
+    // Mark a component of an entity as changed at the current tick, see World::MarkChanged.
+    template <typename ComponentT>
+    void MarkChanged(Entity entity)
+    {
+        world_.MarkChanged<ComponentT>(entity);
+    }
+
+    // Current world tick, see World::GetTick.
+    Tick GetTick() const noexcept { return world_.GetTick(); }
 
 private:
     // Only world can create these objects.
@@ -347,44 +740,214 @@ private:
     friend class World;
 };
 
-template <typename ComponentT, typename StorageT>
-inline StorageT& World::GetComponentStorage()
+template <typename ComponentT>
+inline ComponentStorageType<ComponentT>& World::GetComponentStorage()
+{
+    using StorageT = ComponentStorageType<ComponentT>;
+
+    auto id = GetComponentTypeId<ComponentT>();
+    assert(id < components_.size() && components_[id]);
+    assert(dynamic_cast<StorageT*>(components_[id].get()) != nullptr);
+
+    auto storage = static_cast<StorageT*>(components_[id].get());
+    return *storage;
+}
+
+template <typename ComponentT>
+inline const ComponentStorageType<ComponentT>& World::GetComponentStorage() const
 {
-    auto index = GetTypeIndex<ComponentT>();
-    assert(components_.find(index) != components_.cend());
+    using StorageT = ComponentStorageType<ComponentT>;
 
-    auto storage = static_cast<StorageT*>(components_[index].get());
+    auto id = GetComponentTypeId<ComponentT>();
+    assert(id < components_.size() && components_[id]);
+    assert(dynamic_cast<const StorageT*>(components_[id].get()) != nullptr);
+
+    auto storage = static_cast<const StorageT*>(components_[id].get());
     return *storage;
 }
 
-template <typename ComponentT, typename StorageT>
-inline void World::RegisterComponent()
+template <typename ComponentT>
+inline void World::RegisterComponent(std::pmr::memory_resource* resource)
 {
+    using StorageT = ComponentStorageType<ComponentT>;
+
     std::lock_guard<std::mutex> lock(component_mutex_);
 
-    auto index = GetTypeIndex<ComponentT>();
-    if (components_.find(index) != components_.cend())
+    auto id = GetComponentTypeId<ComponentT>();
+    if (id < components_.size() && components_[id])
     {
         throw std::runtime_error("World: component type already registered.");
     }
 
-    components_.emplace(index, std::make_unique<StorageT>());
+    if (storages_.size() == kMaxComponentTypes)
+    {
+        throw std::runtime_error("World: too many component types, increase YECS_MAX_COMPONENT_TYPES.");
+    }
+
+    if (id >= components_.size())
+    {
+        components_.resize(id + 1);
+        component_bits_.resize(id + 1, kInvalidComponentBit);
+    }
+
+    auto bit = storages_.size();
+
+    components_[id]     = CreateComponentStorage<StorageT>(resource ? resource : resource_);
+    component_bits_[id] = bit;
+    storages_.push_back(components_[id].get());
+    component_ticks_.emplace_back();
+
+    if constexpr (std::is_constructible_v<StorageT, ArchetypeTable&>)
+    {
+        archetype_components_.set(bit);
+    }
+}
+
+template <typename StorageT>
+inline std::unique_ptr<StorageT> World::CreateComponentStorage(std::pmr::memory_resource* resource)
+{
+    if constexpr (std::is_constructible_v<StorageT, ArchetypeTable&>)
+    {
+        return std::make_unique<StorageT>(archetypes_);
+    }
+    else if constexpr (std::is_constructible_v<StorageT, std::pmr::memory_resource*>)
+    {
+        return std::make_unique<StorageT>(resource);
+    }
+    else
+    {
+        return std::make_unique<StorageT>();
+    }
+}
+
+template <typename ComponentT>
+inline decltype(auto) World::AddComponent(Entity entity)
+{
+    return EmplaceComponent<ComponentT>(entity);
+}
+
+template <typename ComponentT, typename... Args>
+inline decltype(auto) World::EmplaceComponent(Entity entity, Args&&... args)
+{
+    std::lock_guard<std::mutex> lock(component_mutex_);
+
+    decltype(auto) component = GetComponentStorage<ComponentT>().EmplaceComponent(entity, std::forward<Args>(args)...);
+    auto           bit       = GetComponentBit(GetComponentTypeId<ComponentT>());
+    UpdateEntityMask(entity, bit, true);
+    StampComponent(GetEntityIndex(entity), bit, true);
+    return component;
+}
+
+template <typename ComponentT>
+inline void World::MarkChanged(Entity entity)
+{
+    auto bit = GetComponentBit(GetComponentTypeId<ComponentT>());
+
+    if (bit == kInvalidComponentBit || !GetEntityMask(entity).test(bit))
+    {
+        throw std::runtime_error("World: entity does not have a component");
+    }
+
+    // Stamps are allocated when a component is added, so no locking is needed here.
+    component_ticks_[bit][GetEntityIndex(entity)].changed = tick_;
+}
+
+template <typename... ComponentTs>
+inline const CachedQuery& World::RegisterQuery()
+{
+    static_assert(sizeof...(ComponentTs) > 0, "Query should have at least one component");
+    return RegisterQuery(GetComponentMask<std::remove_const_t<ComponentTs>...>());
+}
+
+template <typename... ComponentTs>
+inline EntityRange World::CreateEntities(size_t count, const ComponentTs&... prototype)
+{
+    std::lock_guard<std::mutex> component_lock(component_mutex_);
+    std::lock_guard<std::mutex> entity_lock(entity_mutex_);
+
+    auto mask = GetComponentMask<ComponentTs...>();
+
+    if (count == 0)
+    {
+        return EntityRange();
+    }
+
+    auto entities = CreateEntitiesNoLock(count, mask);
+
+    // Archetype components are placed into their final archetype at once, other storages add the batch.
+    ArchetypeSignature signature = 0;
+    auto add = [this, &entities, &signature](const auto& value) {
+        using ComponentT = std::decay_t<decltype(value)>;
+        if constexpr (std::is_constructible_v<ComponentStorageType<ComponentT>, ArchetypeTable&>)
+        {
+            signature |= ArchetypeSignature(1) << archetypes_.GetComponentBit<ComponentT>();
+        }
+        else
+        {
+            GetComponentStorage<ComponentT>().AddComponents(entities, value);
+        }
+    };
+    (add(prototype), ...);
+
+    if (signature)
+    {
+        archetypes_.AddEntities(entities, signature, [this, &prototype...](size_t bit, void* ptr) {
+            auto construct = [this, bit, ptr](const auto& value) {
+                using ComponentT = std::decay_t<decltype(value)>;
+                if constexpr (std::is_constructible_v<ComponentStorageType<ComponentT>, ArchetypeTable&>)
+                {
+                    if (archetypes_.GetComponentBit<ComponentT>() == bit)
+                    {
+                        new (ptr) ComponentT(value);
+                    }
+                }
+            };
+            (construct(prototype), ...);
+        });
+    }
+
+    return entities;
 }
 
 template <typename ComponentT>
-inline ComponentT& World::AddComponent(Entity entity)
+inline void World::RemoveComponent(Entity entity)
 {
     std::lock_guard<std::mutex> lock(component_mutex_);
 
-    return GetComponentStorage<ComponentT>().AddComponent(entity);
+    GetComponentStorage<ComponentT>().RemoveComponent(entity);
+    UpdateEntityMask(entity, GetComponentBit(GetComponentTypeId<ComponentT>()), false);
+}
+
+template <typename... ComponentTs>
+inline ComponentMask World::GetComponentMask() const
+{
+    ComponentMask mask;
+
+    [[maybe_unused]] auto set_bit = [this, &mask](TypeId id) {
+        auto bit = GetComponentBit(id);
+        if (bit == kInvalidComponentBit)
+        {
+            throw std::runtime_error("World: component type not registered");
+        }
+        mask.set(bit);
+    };
+
+    (set_bit(GetComponentTypeId<ComponentTs>()), ...);
+    return mask;
 }
 
 template <typename ComponentT>
-inline ComponentT& World::GetComponent(Entity entity)
+inline decltype(auto) World::GetComponent(Entity entity)
 {
     return GetComponentStorage<ComponentT>().GetComponent(entity);
 }
 
+template <typename ComponentT>
+inline bool World::HasComponent(Entity entity) const
+{
+    return GetComponentStorage<ComponentT>().HasComponent(entity);
+}
+
 // Direct component access.
 template <typename ComponentT>
 size_t World::GetNumComponents() const
@@ -393,13 +956,13 @@ size_t World::GetNumComponents() const
 }
 
 template <typename ComponentT>
-ComponentT& World::GetComponentByIndex(ComponentIndex i)
+decltype(auto) World::GetComponentByIndex(ComponentIndex i)
 {
     return GetComponentStorage<ComponentT>()[i];
 }
 
 template <typename ComponentT>
-const ComponentT& World::GetComponentByIndex(ComponentIndex i) const
+decltype(auto) World::GetComponentByIndex(ComponentIndex i) const
 {
     return GetComponentStorage<ComponentT>()[i];
 }
@@ -409,74 +972,270 @@ inline void World::RegisterSystem(Args&&... args)
 {
     std::lock_guard<std::mutex> lock(system_mutex_);
 
-    auto index = GetTypeIndex<SystemT>();
+    auto id = GetSystemTypeId<SystemT>();
 
-    if (systems_.find(index) != systems_.cend())
+    if (GetSystemIndex(id) != kInvalidSystemIndex)
     {
         throw std::runtime_error("World: system type already registered");
     }
 
     SystemInvoke invoke;
-    invoke.system = std::make_unique<SystemT>(std::forward<Args>(args)...);
-    invoke.task   = taskflow_.emplace([system = invoke.system.get(), this](tf::Subflow& subflow) {
-        ComponentAccess access(*this);
-        EntityQuery     query(*this);
-        system->Run(access, query, subflow);
-    });
+    invoke.system   = std::make_unique<SystemT>(std::forward<Args>(args)...);
+    invoke.declared = detail::SystemReads<SystemT>::kDeclared || detail::SystemWrites<SystemT>::kDeclared;
+    invoke.reads    = detail::SystemReads<SystemT>::Build();
+    invoke.writes   = detail::SystemWrites<SystemT>::Build();
+
+    if (id >= system_indices_.size())
+    {
+        system_indices_.resize(id + 1, kInvalidSystemIndex);
+    }
 
-    systems_.emplace(index, std::move(invoke));
+    system_indices_[id] = systems_.size();
+    systems_.push_back(std::move(invoke));
+    taskflow_dirty_ = true;
 }
 
-template <typename ComponentT>
-inline World::EntityBuilder& World::EntityBuilder::AddComponent()
+template <typename ComponentT, typename... Args>
+inline World::EntityBuilder& World::EntityBuilder::AddComponent(Args&&... args)
 {
-    world_.AddComponent<ComponentT>(entity_);
+    world_.EmplaceComponent<ComponentT>(entity_, std::forward<Args>(args)...);
     return *this;
 }
 
 inline ComponentAccess::ComponentAccess(World& world) noexcept : world_(world) {}
 
-template <typename ComponentT, typename StorageT>
-inline StorageT& ComponentAccess::Write()
+template <typename ComponentT>
+inline ComponentStorageType<ComponentT>& ComponentAccess::Write()
 {
     return world_.GetComponentStorage<ComponentT>();
 }
 
-template <typename ComponentT, typename StorageT>
-inline const StorageT& ComponentAccess::Read() const
+template <typename ComponentT>
+inline const ComponentStorageType<ComponentT>& ComponentAccess::Read() const
 {
     return world_.GetComponentStorage<ComponentT>();
 }
 
+template <typename... ComponentTs>
+inline yecs::View<ComponentTs...> ComponentAccess::View()
+{
+    return yecs::View<ComponentTs...>(world_.GetComponentStorage<std::remove_const_t<ComponentTs>>()...);
+}
+
+template <typename... ComponentTs>
+inline yecs::ArchetypeView<ComponentTs...> ComponentAccess::ArchetypeView() const
+{
+    return yecs::ArchetypeView<ComponentTs...>(world_.archetypes_);
+}
+
+template <typename... ComponentTs>
+inline auto EntityQuery::HasComponents() const
+{
+    return [mask = world_.GetComponentMask<ComponentTs...>(), &masks = world_.component_masks_](Entity entity) {
+        auto index = GetEntityIndex(entity);
+        return index < masks.size() && (masks[index] & mask) == mask;
+    };
+}
+
+template <typename... ComponentTs>
+inline const CachedQuery& EntityQuery::Cached() const
+{
+    return world_.RegisterQuery<ComponentTs...>();
+}
+
+template <typename ComponentT>
+inline EntitySet EntityQuery::Changed(Tick since) const
+{
+    return Stamped<ComponentT>(since, false);
+}
+
+template <typename ComponentT>
+inline EntitySet EntityQuery::Added(Tick since) const
+{
+    return Stamped<ComponentT>(since, true);
+}
+
+template <typename ComponentT>
+inline EntitySet EntityQuery::Stamped(Tick since, bool added) const
+{
+    auto bit = world_.GetComponentBit(GetComponentTypeId<ComponentT>());
+
+    if (bit == kInvalidComponentBit)
+    {
+        throw std::runtime_error("World: component type not registered");
+    }
+
+    auto& ticks = world_.component_ticks_[bit];
+    auto& masks = world_.component_masks_;
+
+    EntitySet::EntityStorage entities(resource_);
+    world_.entities_.ForEach([this, bit, since, added, &ticks, &masks, &entities](EntityIndex i) {
+        if (i < ticks.size() && i < masks.size() && masks[i].test(bit) &&
+            (added ? ticks[i].added : ticks[i].changed) >= since)
+        {
+            entities.push_back(MakeEntity(i, world_.generations_[i]));
+        }
+    });
+    return EntitySet(std::move(entities), true);
+}
+
+template <typename ComponentT>
+inline void EntityQuery::AppendTagBits(TagBits& tag_bits) const
+{
+    using StorageT = ComponentStorageType<std::remove_const_t<ComponentT>>;
+
+    if constexpr (IsTagStorage<StorageT>::value)
+    {
+        tag_bits.push_back(&world_.GetComponentStorage<std::remove_const_t<ComponentT>>().bits());
+    }
+}
+
+template <typename F>
+inline void EntityQuery::ForEachMatching(const ComponentMask& required,
+                                         const ComponentMask& excluded,
+                                         const TagBits&       required_tags,
+                                         const TagBits&       excluded_tags,
+                                         F&&                  f) const
+{
+    auto& masks = world_.component_masks_;
+
+    world_.entities_.ForEachWord([&](size_t word, uint64_t bits) {
+        // Drop entities missing any of the required tags or having any of the excluded ones 64 entities at a time.
+        for (auto tag : required_tags) { bits &= word < tag->words().size() ? tag->words()[word] : 0; }
+        for (auto tag : excluded_tags) { bits &= word < tag->words().size() ? ~tag->words()[word] : ~uint64_t(0); }
+
+        for (; bits; bits &= bits - 1)
+        {
+            auto i = static_cast<EntityIndex>(word * EntityBitset::kWordBits + CountTrailingZeros(bits));
+            if (i < masks.size() ? (masks[i] & required) == required && (masks[i] & excluded).none() : required.none())
+            {
+                f(i);
+            }
+        }
+    });
+}
+
+template <typename... WithTs, typename... WithoutTs, typename F>
+inline void EntityQuery::ForEachMatching(std::tuple<WithTs...>*, std::tuple<WithoutTs...>*, F&& f) const
+{
+    auto required = world_.GetComponentMask<std::remove_const_t<WithTs>...>();
+    auto excluded = world_.GetComponentMask<std::remove_const_t<WithoutTs>...>();
+
+    TagBits required_tags(resource_);
+    TagBits excluded_tags(resource_);
+    (AppendTagBits<WithTs>(required_tags), ...);
+    (AppendTagBits<WithoutTs>(excluded_tags), ...);
+
+    ForEachMatching(required, excluded, required_tags, excluded_tags, std::forward<F>(f));
+}
+
+template <typename... ComponentTs>
+inline EntitySet EntityQuery::WithComponents() const
+{
+    return Match<With<ComponentTs...>>();
+}
+
+template <typename... TermTs>
+inline EntitySet EntityQuery::Match() const
+{
+    using Terms = detail::QueryTerms<TermTs...>;
+
+    EntitySet::EntityStorage entities(resource_);
+    ForEachMatching(static_cast<typename Terms::WithTypes*>(nullptr),
+                    static_cast<typename Terms::WithoutTypes*>(nullptr),
+                    [this, &entities](EntityIndex i) { entities.push_back(MakeEntity(i, world_.generations_[i])); });
+    return EntitySet(std::move(entities), true);
+}
+
+template <typename... TermTs>
+inline CompressedEntitySet EntityQuery::MatchCompressed() const
+{
+    using Terms = detail::QueryTerms<TermTs...>;
+
+    CompressedEntitySet::Builder builder(world_.generations_, resource_);
+    ForEachMatching(static_cast<typename Terms::WithTypes*>(nullptr),
+                    static_cast<typename Terms::WithoutTypes*>(nullptr),
+                    [&builder](EntityIndex i) { builder.Append(i); });
+    return builder.Build();
+}
+
+template <typename... TermTs, typename F>
+inline void EntityQuery::ForEach(F&& f) const
+{
+    using Terms = detail::QueryTerms<TermTs...>;
+
+    ForEach(static_cast<typename Terms::WithTypes*>(nullptr),
+            static_cast<typename Terms::WithoutTypes*>(nullptr),
+            static_cast<typename Terms::OptionalTypes*>(nullptr),
+            f);
+}
+
+template <typename... WithTs, typename... WithoutTs, typename... OptionalTs, typename F>
+inline void EntityQuery::ForEach(std::tuple<WithTs...>*,
+                                 std::tuple<WithoutTs...>*,
+                                 std::tuple<OptionalTs...>*,
+                                 F& f) const
+{
+    static_assert((std::is_lvalue_reference_v<decltype(
+                       std::declval<detail::QueryStorageRef<OptionalTs>>().GetComponent(Entity()))> &&
+                   ...),
+                  "Optional components should be stored as objects, not proxies");
+
+    // Throws if any of the types is not registered, storages are looked up once.
+    world_.GetComponentMask<std::remove_const_t<WithTs>..., std::remove_const_t<OptionalTs>...>();
+
+    std::tuple<detail::QueryStorageRef<WithTs>...> with(world_.GetComponentStorage<std::remove_const_t<WithTs>>()...);
+    std::tuple<std::pair<detail::QueryStorageRef<OptionalTs>, size_t>...> optional(
+        {world_.GetComponentStorage<std::remove_const_t<OptionalTs>>(),
+         world_.GetComponentBit(GetComponentTypeId<std::remove_const_t<OptionalTs>>())}...);
+
+    auto& masks = world_.component_masks_;
+
+    ForEachMatching(static_cast<std::tuple<WithTs...>*>(nullptr),
+                    static_cast<std::tuple<WithoutTs...>*>(nullptr),
+                    [this, &f, &with, &optional, &masks](EntityIndex i) {
+                        auto entity = MakeEntity(i, world_.generations_[i]);
+
+                        // Optional components are looked up only if entity mask has them.
+                        [[maybe_unused]] auto get = [i, entity, &masks](auto& storage_bit) {
+                            return i < masks.size() && masks[i].test(storage_bit.second)
+                                       ? &storage_bit.first.GetComponent(entity)
+                                       : nullptr;
+                        };
+
+                        f(entity,
+                          std::get<detail::QueryStorageRef<WithTs>>(with).GetComponent(entity)...,
+                          get(std::get<std::pair<detail::QueryStorageRef<OptionalTs>, size_t>>(optional))...);
+                    });
+}
+
 template <typename SystemT>
 inline SystemT& World::GetSystem()
 {
-    auto index = GetTypeIndex<SystemT>();
+    auto index = GetSystemIndex(GetSystemTypeId<SystemT>());
 
-    auto system = systems_.find(index);
-
-    if (system == systems_.cend())
+    if (index == kInvalidSystemIndex)
     {
         throw std::runtime_error("World: system type not found");
     }
 
-    return reinterpret_cast<SystemT&>(*system->second.system.get());
+    return static_cast<SystemT&>(*systems_[index].system);
 }
 
 template <typename SystemT0, typename SystemT1>
 inline void World::Precede()
 {
-    auto index0 = GetTypeIndex<SystemT0>();
-    auto index1 = GetTypeIndex<SystemT1>();
-
-    auto system0 = systems_.find(index0);
-    auto system1 = systems_.find(index1);
+    auto index0 = GetSystemIndex(GetSystemTypeId<SystemT0>());
+    auto index1 = GetSystemIndex(GetSystemTypeId<SystemT1>());
 
-    if (system0 == systems_.cend() || system1 == systems_.cend())
+    if (index0 == kInvalidSystemIndex || index1 == kInvalidSystemIndex)
     {
         throw std::runtime_error("World: system type not found");
     }
 
-    system0->second.task.precede(system1->second.task);
+    std::lock_guard<std::mutex> lock(system_mutex_);
+
+    precedence_.emplace_back(index0, index1);
+    taskflow_dirty_ = true;
 }
 }  // namespace yecs
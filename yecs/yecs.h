@@ -23,6 +23,10 @@ SOFTWARE.
 ****************************************************************************/
 #pragma once
 
+#include "yecs/cached_query.h"
 #include "yecs/common.h"
+#include "yecs/paged_component_storage.h"
+#include "yecs/soa_component_storage.h"
 #include "yecs/system.h"
+#include "yecs/tag_storage.h"
 #include "yecs/world.h"